@@ -1,10 +1,26 @@
 
+// AttachConsole needs Windows XP.
+#if defined(_WIN32) && !defined(_WIN32_WINNT)
+#define _WIN32_WINNT 0x0501
+#endif
+
 #include <wx/wx.h>
 #include <wx/dirdlg.h>
 #include <wx/aboutdlg.h>
 
 #include "Grader.h"
 #include "TemplateMaker.h"
+#include "GradingBatch.h"
+#include "GradingGradebook.h"
+#include "GradingMigrate.h"
+#include "GradingRegrade.h"
+#include "GradingRules.h"
+#include "GradingTests.h"
+#include "GradingWhatIf.h"
+#include <stdio.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 // ----------------------------------------------------------------------------
 // Constants
@@ -15,9 +31,57 @@ const int ID_NEXT = 501;
 const int ID_PREV = 502;
 const int ID_SAVE = 503;
 const int ID_AUTOSAVE = 504;
+const int ID_WHATIF = 505;
 
 static const long TOOLBAR_STYLE = wxTB_FLAT | wxTB_DOCKABLE;
 
+// ----------------------------------------------------------------------------
+// Idle tasks
+// ----------------------------------------------------------------------------
+
+// Asks for a student to be prefetched once the one that was just opened has
+// been drawn, instead of holding up the switch to them.
+class PrefetchTask: public GradingTask
+{
+  public:
+  PrefetchTask(GradingTools *tools, std::string directory):
+    m_tools(tools),
+    m_directory(directory)
+  {
+  }
+
+  bool Step()
+  {
+    m_tools->Prefetch(m_directory);
+    return false;
+  }
+
+  protected:
+  GradingTools *m_tools;
+  std::string m_directory;
+};
+
+// Saves the roster's manifest when there's nothing else going on, so the next
+// session starts from what this one found.
+class SaveManifestTask: public GradingTask
+{
+  public:
+  SaveManifestTask(GradingManifest *manifest):
+    m_manifest(manifest)
+  {
+  }
+
+  bool Step()
+  {
+    if (m_manifest->IsModified())
+      m_manifest->Save();
+    return false;
+  }
+
+  protected:
+  GradingManifest *m_manifest;
+};
+
 // ----------------------------------------------------------------------------
 // Event table for GraderFrame
 // ----------------------------------------------------------------------------
@@ -26,6 +90,7 @@ BEGIN_EVENT_TABLE(GraderFrame, wxFrame)
   EVT_SIZE(GraderFrame::OnSize)
   EVT_MENU(wxID_ANY, GraderFrame::OnToolLeftClick)
   EVT_IDLE(GraderFrame::OnIdle)
+  EVT_COMMAND(wxID_ANY, wxEVT_GRADING_MODIFIED, GraderFrame::OnModified)
 END_EVENT_TABLE()
 
 // ----------------------------------------------------------------------------
@@ -50,11 +115,15 @@ GraderFrame::GraderFrame(wxWindow *parent, const wxString &title, const wxPoint
   wxMenu *fileMenu = new wxMenu;
   fileMenu->Append(wxID_EXIT, _T("E&xit\tAlt-F4"), _T("Exit"));
 
+  wxMenu *toolsMenu = new wxMenu;
+  toolsMenu->Append(ID_WHATIF, _T("&What if..."), _T("Try out different point values on everyone graded so far"));
+
   wxMenu *helpMenu = new wxMenu;
   helpMenu->Append(wxID_ABOUT, _T("&About"), _T("About"));
 
   wxMenuBar *menuBar = new wxMenuBar(wxMB_DOCKABLE);
   menuBar->Append(fileMenu, _T("&File"));
+  menuBar->Append(toolsMenu, _T("&Tools"));
   menuBar->Append(helpMenu, _T("&Help"));
 
   SetMenuBar(menuBar);
@@ -65,6 +134,17 @@ GraderFrame::GraderFrame(wxWindow *parent, const wxString &title, const wxPoint
   m_maker = NULL;
 }
 
+GraderFrame::~GraderFrame()
+{
+  // The tools' prefetcher reads through the roster's manifest, so it has to be
+  // stopped before the roster goes away.
+  delete m_tools;
+  m_tools = NULL;
+
+  if (m_roster.GetManifest()->IsModified())
+    m_roster.GetManifest()->Save();
+}
+
 void GraderFrame::OnExit(wxCommandEvent &WXUNUSED(event))
 {
   Close(true);
@@ -100,18 +180,48 @@ GraderFrame *GraderFrame::Create(GraderFrame *parentFrame)
     while (fd->ShowModal() != wxID_OK);
     templateFilename = fd->GetPath();
 
-    wxDirDialog(frame, "Now, show me the first student's directory, please!", "", wxDD_DEFAULT_STYLE | wxDD_CHANGE_DIR).ShowModal();
-
-    std::string root = wxGetCwd().c_str();
-    size_t pos = root.find_last_of("/\\");
-    frame->m_currentStudent = &root[pos + 1];
-    frame->SetLabel(frame->m_currentStudent);
-    root.resize(pos);
+    // Previous and next only work from a student in the roster, so keep asking
+    // until we get one.
+    std::string student;
+    for (;;)
+    {
+      wxDirDialog dirDlg(frame, "Now, show me the first student's directory, please!", "", wxDD_DEFAULT_STYLE | wxDD_CHANGE_DIR);
+      if (dirDlg.ShowModal() != wxID_OK)
+        exit(0);
+
+      std::string root = dirDlg.GetPath().c_str();
+      size_t pos = root.find_last_of("/\\");
+      if (pos == std::string::npos)
+        continue;
+      student = &root[pos + 1];
+      root.resize(pos);
+
+      if (!frame->m_roster.Open(root))
+        wxMessageBox(("I couldn't read the student directories in " + root + ".").c_str(), "Oops.", wxOK, frame);
+      else if (!frame->m_roster.SetCurrent(student))
+        wxMessageBox((student + " doesn't look like a student directory in " + root + ".").c_str(), "Oops.", wxOK, frame);
+      else
+        break;
+    }
+    frame->SetLabel(student);
 
-    frame->m_root.Open(root);
+    frame->m_scheduler.Add(new SaveManifestTask(frame->m_roster.GetManifest()), GradingScheduler::PRIORITY_LOW);
 
-    frame->m_tools = new GradingTools(part, frame->m_panel, templateFilename);
+    frame->m_tools = new GradingTools(part, frame->m_panel, templateFilename,
+      frame->m_roster.GetStudentPath(frame->m_roster.GetCurrent()), frame->m_roster.GetManifest());
     frame->m_panel->GetSizer()->Add(frame->m_tools, 1, wxEXPAND, 0);
+    frame->UpdateTitle();
+
+    // Everyone else gets compiled in the background, starting from here; the
+    // first student was already put at the front of the line when they were
+    // opened. The paths have to be the roster's, the same ones navigation
+    // uses, or the compiler would take them for different students.
+    for (size_t i = 1; i < frame->m_roster.GetCount(); i++)
+      frame->m_tools->Compile(frame->m_roster.GetStudentPath((frame->m_roster.GetCurrent() + i) % frame->m_roster.GetCount()));
+
+    int next = frame->m_roster.GetCurrent() + 1;
+    if (next > 0 && next < (int)frame->m_roster.GetCount())
+      frame->m_scheduler.Add(new PrefetchTask(frame->m_tools, frame->m_roster.GetStudentPath(next)), GradingScheduler::PRIORITY_HIGH);
   }
 
   frame->m_panel->GetSizer()->Layout();
@@ -192,41 +302,22 @@ void GraderFrame::ShiftStudent(int d)
 
   wxSize size = GetSize();
 
-  wxDir root(m_root.GetName());
-  wxString filename;
-  wxString last = "";
-
-  bool more = m_root.GetFirst(&filename, "", wxDIR_DIRS);
-  while (more)
-  {
-    if (filename == m_currentStudent)
-    {
-      if (d == -1 && last.length() == 0)
-        return;
-      else if (d == -1)
-      {
-        m_currentStudent = last;
-        break;
-      }
-      else if (d == 1)
-      {
-        more = m_root.GetNext(&filename);
-        if (!more)
-          return;
-        m_currentStudent = filename;
-        break;
-      }
-    }
-    last = filename;
-    more = m_root.GetNext(&filename);
-  }
+  if (!m_roster.Shift(d))
+    return;
 
-  if (m_autosave)
+  // Students who were only looked at aren't rewritten.
+  if (m_autosave && m_tools->IsModified())
     m_tools->SaveScoreSheet();
 
-  wxSetWorkingDirectory(m_root.GetName() + '/' + m_currentStudent);
-  m_tools->UpdateDirectory();
-  SetLabel(m_currentStudent);
+  wxSetWorkingDirectory(m_roster.GetStudentPath(m_roster.GetCurrent()));
+  m_tools->UpdateDirectory(m_roster.GetStudentPath(m_roster.GetCurrent()));
+  UpdateTitle();
+
+  // Whoever's next in the same direction is probably who we'll want after this
+  int next = m_roster.GetCurrent() + d;
+  if (next >= 0 && next < (int)m_roster.GetCount())
+    m_scheduler.Add(new PrefetchTask(m_tools, m_roster.GetStudentPath(next)), GradingScheduler::PRIORITY_HIGH);
+  m_scheduler.Add(new SaveManifestTask(m_roster.GetManifest()), GradingScheduler::PRIORITY_LOW);
 
   wxSize newSize = GetSize();
 
@@ -235,14 +326,32 @@ void GraderFrame::ShiftStudent(int d)
   LayoutChildren();
 }
 
+// The title is the current student, with a star if they have unsaved changes.
+void GraderFrame::UpdateTitle()
+{
+  std::string title = m_roster.GetCurrentStudent();
+  if (m_tools && m_tools->IsModified())
+    title += " *";
+
+  SetLabel(title);
+}
+
+void GraderFrame::OnModified(wxCommandEvent &event)
+{
+  UpdateTitle();
+}
+
 void GraderFrame::OnSize(wxSizeEvent &event)
 {
   LayoutChildren();
 }
 
+// More idle events are only asked for while the scheduler has work left, so
+// the program sleeps between events instead of spinning.
 void GraderFrame::OnIdle(wxIdleEvent &event)
 {
-  event.RequestMore();
+  if (m_scheduler.Run())
+    event.RequestMore();
 }
 
 void GraderFrame::OnQuit(wxCommandEvent &WXUNUSED(event))
@@ -267,6 +376,14 @@ void GraderFrame::OnToolLeftClick(wxCommandEvent &event)
   }
   else if (id == ID_AUTOSAVE)
     m_autosave = event.IsChecked();
+  else if (id == ID_WHATIF)
+  {
+    if (m_tools && m_tools->GetTemplate())
+    {
+      GradingWhatIf whatIf(this, m_tools->GetTemplate(), m_roster, m_tools->GetAssignmentPart());
+      whatIf.ShowModal();
+    }
+  }
   else if (id == wxID_EXIT)
     OnExit(event);
   else if (id == wxID_ABOUT)
@@ -291,8 +408,56 @@ annoys you, you can tell me about it at jeffs@bu.edu.");
 
 IMPLEMENT_APP(GraderApp)
 
+// The grader's a GUI program, so on Windows it doesn't get a console of its
+// own, and anything the command line tools print goes nowhere unless they
+// borrow the one they were run from.
+static void AttachParentConsole()
+{
+#ifdef _WIN32
+  if (AttachConsole(ATTACH_PARENT_PROCESS))
+  {
+    freopen("CONOUT$", "w", stdout);
+    freopen("CONOUT$", "w", stderr);
+  }
+#endif
+}
+
+static int PrintUsage(const char *program)
+{
+  fprintf(stderr, "usage: %s --batch <part> <roster root>\n", program);
+  fprintf(stderr, "       %s --gradebook <part> <roster root> <output> [csv|canvas|blackboard]\n", program);
+  fprintf(stderr, "       %s --regrade <part> <roster root> <template>\n", program);
+  fprintf(stderr, "       %s --migrate <part> <roster root> <template> [--write]\n", program);
+  fprintf(stderr, "       %s --test <part> <roster root> <template>\n", program);
+  fprintf(stderr, "       %s --rules <part> <roster root> <template>\n", program);
+  fprintf(stderr, "or with no arguments at all to open the grader.\n");
+  return 2;
+}
+
 bool GraderApp::OnInit()
 {
+  // Any arguments mean we're being run from the command line, so skip the GUI.
+  if (argc > 1)
+  {
+    AttachParentConsole();
+
+    std::string mode = argv[1];
+    if (mode == "--batch")
+      exit(GradingBatch::Main(argc, argv));
+    else if (mode == "--gradebook")
+      exit(GradingGradebook::Main(argc, argv));
+    else if (mode == "--regrade")
+      exit(GradingRegrade::Main(argc, argv));
+    else if (mode == "--migrate")
+      exit(GradingMigrate::Main(argc, argv));
+    else if (mode == "--test")
+      exit(GradingTests::Main(argc, argv));
+    else if (mode == "--rules")
+      exit(GradingRules::Main(argc, argv));
+    else
+      exit(PrintUsage(argv[0]));
+  }
+
   m_frame = GraderFrame::Create(NULL);
 
   return true;
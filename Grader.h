@@ -6,12 +6,15 @@
 #include <wx/dir.h>
 
 #include "GradingTools.h"
+#include "GradingRoster.h"
+#include "GradingScheduler.h"
 #include "TemplateMaker.h"
 
 class GraderFrame: public wxFrame
 {
   public:
   static GraderFrame *Create(GraderFrame *parentFrame);
+  ~GraderFrame();
 
   void OnExit(wxCommandEvent& event);
 
@@ -28,19 +31,21 @@ class GraderFrame: public wxFrame
   void OnToolLeftClick(wxCommandEvent &event);
   void OnSize(wxSizeEvent &event);
   void OnAbout(wxCommandEvent &event);
+  void OnModified(wxCommandEvent &event);
 
   protected:
   void LayoutChildren();
 
   void ShiftStudent(int d);
+  void UpdateTitle();
 
   wxPanel *m_panel;
   wxToolBar *m_tbar;
   GradingTools *m_tools;
   TemplateMaker *m_maker;
 
-  wxDir m_root;
-  std::string m_currentStudent;
+  GradingRoster m_roster;
+  GradingScheduler m_scheduler;
   bool m_autosave;
 
   DECLARE_EVENT_TABLE()
@@ -0,0 +1,85 @@
+#include "GradingBatch.h"
+
+#include <stdio.h>
+
+GradingBatch::GradingBatch(std::string root, const sAssignmentPart &part):
+  GradingRosterTool(root, part)
+{
+  m_written = 0;
+  m_skipped = 0;
+}
+
+GradingBatch::~GradingBatch()
+{
+}
+
+size_t GradingBatch::GetWrittenCount() const
+{
+  return m_written;
+}
+
+size_t GradingBatch::GetSkippedCount() const
+{
+  return m_skipped;
+}
+
+void GradingBatch::OnRunStart(int threads)
+{
+  m_written = 0;
+  m_skipped = 0;
+}
+
+void GradingBatch::ProcessStudent(size_t index)
+{
+  GradingSheet sheet;
+  std::string gradeFilename;
+  SheetStatus status = ReadSheet(index, &sheet, &gradeFilename);
+
+  if (status == SHEET_MISSING)
+  {
+    wxMutexLocker lock(m_mutex);
+    m_skipped++;
+    return;
+  }
+  if (status != SHEET_READ)
+    return;
+
+  if (!sheet.SaveGradeFile(gradeFilename))
+  {
+    AddError(m_roster.GetStudent(index) + ": couldn't write " + gradeFilename);
+    return;
+  }
+
+  wxMutexLocker lock(m_mutex);
+  m_written++;
+}
+
+int GradingBatch::Main(int argc, char **argv)
+{
+  if (argc != 4 || std::string(argv[1]) != "--batch")
+  {
+    fprintf(stderr, "usage: %s --batch <part> <roster root>\n", argv[0]);
+    return 2;
+  }
+
+  sAssignmentPart part;
+  if (!LoadPart(argv[2], &part))
+    return 1;
+
+  GradingBatch batch(argv[3], part);
+  if (!batch.Scan())
+  {
+    fprintf(stderr, "I couldn't open the roster directory %s.\n", argv[3]);
+    return 1;
+  }
+
+  batch.Run();
+  batch.PrintErrors();
+
+  const std::vector<std::string> &errors = batch.GetErrors();
+  printf("Wrote %u grade files for %u students (%u without a score sheet, %u awaiting confirmation, %u errors).\n",
+    (unsigned int)batch.GetWrittenCount(), (unsigned int)batch.GetStudentCount(),
+    (unsigned int)batch.GetSkippedCount(), (unsigned int)batch.GetUnconfirmedCount(), (unsigned int)errors.size());
+
+  return errors.size() > 0;
+}
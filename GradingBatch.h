@@ -0,0 +1,35 @@
+#ifndef GRADINGBATCH_H
+#define GRADINGBATCH_H
+
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+#include "GradingRosterTool.h"
+
+// The batch runner regenerates every student's grade file from their .ss sheet
+// without opening any windows, on a pool of worker threads (see
+// GradingRosterTool). Each grade file comes out exactly as
+// GradingTools::SaveScoreSheet would write it.
+
+class GradingBatch: public GradingRosterTool
+{
+  public:
+  GradingBatch(std::string root, const sAssignmentPart &part);
+  ~GradingBatch();
+
+  size_t GetWrittenCount() const;
+  size_t GetSkippedCount() const;
+
+  // Command line entry point: grader --batch <part> <roster root>
+  static int Main(int argc, char **argv);
+
+  protected:
+  size_t m_written;
+  size_t m_skipped;
+
+  void OnRunStart(int threads);
+  void ProcessStudent(size_t index);
+};
+
+#endif
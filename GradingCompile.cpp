@@ -0,0 +1,398 @@
+#include "GradingCompile.h"
+
+#include <wx/dir.h>
+#include <wx/filefn.h>
+#include <wx/stdpaths.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+DEFINE_EVENT_TYPE(wxEVT_GRADING_COMPILED)
+
+// Every compiler is a whole JVM, more or less, so more than a few at once just
+// fights over memory.
+static const int MAX_THREADS = 4;
+
+// Even a big project shouldn't take anywhere near this long.
+static const int COMPILE_SECONDS = 120;
+
+//-----GradingCompiler::Worker-----
+
+GradingCompiler::Worker::Worker(GradingCompiler *compiler):
+  wxThread(wxTHREAD_JOINABLE),
+  m_compiler(compiler)
+{
+}
+
+wxThread::ExitCode GradingCompiler::Worker::Entry()
+{
+  std::string directory;
+  while (m_compiler->NextJob(&directory))
+    m_compiler->Compile(directory);
+
+  return 0;
+}
+
+//-----GradingCompiler-----
+
+GradingCompiler::GradingCompiler(wxEvtHandler *handler, const sAssignmentPart &part, GradingManifest *manifest):
+  m_handler(handler),
+  m_part(part),
+  m_manifest(manifest),
+  m_condition(m_mutex)
+{
+  m_stop = false;
+
+  std::string dataDirectory = wxStandardPaths::Get().GetUserDataDir().c_str();
+  m_cacheDirectory = dataDirectory + "/compiles";
+  if (!wxDirExists(dataDirectory))
+    wxMkdir(dataDirectory);
+  if (!wxDirExists(m_cacheDirectory))
+    wxMkdir(m_cacheDirectory);
+}
+
+GradingCompiler::~GradingCompiler()
+{
+  Stop();
+}
+
+void GradingCompiler::Start(int threads)
+{
+  if (threads <= 0)
+    threads = wxThread::GetCPUCount();
+  if (threads <= 0)
+    threads = 1;
+  if (threads > MAX_THREADS)
+    threads = MAX_THREADS;
+
+  for (int i = 0; i < threads; i++)
+  {
+    Worker *worker = new Worker(this);
+    if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR)
+    {
+      delete worker;
+      continue;
+    }
+    m_workers.push_back(worker);
+  }
+}
+
+// Whatever's being compiled right now is finished first; everything still
+// waiting is dropped.
+void GradingCompiler::Stop()
+{
+  {
+    wxMutexLocker lock(m_mutex);
+    m_stop = true;
+    m_queue.clear();
+    m_condition.Broadcast();
+  }
+
+  for (size_t i = 0; i < m_workers.size(); i++)
+  {
+    m_workers[i]->Wait();
+    delete m_workers[i];
+  }
+  m_workers.clear();
+}
+
+// Students who are already queued, being compiled or done are left alone;
+// Hurry is for checking them again.
+void GradingCompiler::Add(std::string directory)
+{
+  wxMutexLocker lock(m_mutex);
+
+  if (std::find(m_queue.begin(), m_queue.end(), directory) != m_queue.end() ||
+    std::find(m_working.begin(), m_working.end(), directory) != m_working.end() ||
+    m_results.find(directory) != m_results.end())
+    return;
+
+  m_queue.push_back(directory);
+  m_condition.Broadcast();
+}
+
+// Puts a student at the front of the line, usually because they were just
+// opened. They're checked again even if they were done before, in case their
+// files changed, but that's only a cache lookup if they didn't.
+void GradingCompiler::Hurry(std::string directory)
+{
+  wxMutexLocker lock(m_mutex);
+
+  if (std::find(m_working.begin(), m_working.end(), directory) != m_working.end())
+    return;
+
+  std::deque<std::string>::iterator it = std::find(m_queue.begin(), m_queue.end(), directory);
+  if (it != m_queue.end())
+    m_queue.erase(it);
+
+  m_queue.push_front(directory);
+  m_condition.Broadcast();
+}
+
+// Returns false if the student hasn't been compiled yet.
+bool GradingCompiler::GetResult(std::string directory, sCompileResult *result) const
+{
+  wxMutexLocker lock(m_mutex);
+
+  std::map<std::string, sCompileResult>::const_iterator it = m_results.find(directory);
+  if (it == m_results.end())
+    return false;
+
+  *result = it->second;
+  return true;
+}
+
+// Fills in the command's placeholders. %% is a plain percent sign.
+std::string GradingCompiler::BuildCommand(std::string command, std::string directory, const std::vector<std::string> &files,
+  std::string output)
+{
+  std::string built;
+
+  for (size_t i = 0; i < command.length(); i++)
+  {
+    if (command[i] != '%' || i + 1 >= command.length())
+    {
+      built += command[i];
+      continue;
+    }
+
+    switch (command[++i])
+    {
+    case 'f':
+      for (size_t j = 0; j < files.size(); j++)
+        built += std::string(j > 0?" ":"") + "\"" + directory + '/' + files[j] + "\"";
+      break;
+    case 'o':
+      built += "\"" + output + "\"";
+      break;
+    case 'd':
+      built += "\"" + directory + "\"";
+      break;
+    default:
+      built += command[i];
+    }
+  }
+
+  return built;
+}
+
+bool GradingCompiler::NextJob(std::string *directory)
+{
+  wxMutexLocker lock(m_mutex);
+
+  while (!m_stop && m_queue.empty())
+    m_condition.Wait();
+
+  if (m_stop)
+    return false;
+
+  *directory = m_queue.front();
+  m_queue.pop_front();
+  m_working.push_back(*directory);
+  return true;
+}
+
+void GradingCompiler::Compile(std::string directory)
+{
+  sCompileResult result;
+  result.ran = false;
+  result.status = 0;
+
+  std::vector<std::string> files;
+  if (!ListSubmissions(directory, &files))
+  {
+    result.output = "I couldn't open the student's directory.";
+    Finish(directory, "", result);
+    return;
+  }
+
+  if (files.size() == 0)
+  {
+    result.output = "There's nothing matching " + m_part.submissionFilter + " to compile.";
+    Finish(directory, "", result);
+    return;
+  }
+
+  std::string key = HashInputs(directory, files);
+  {
+    wxMutexLocker lock(m_mutex);
+
+    std::map<std::string, sCompileResult>::const_iterator it = m_cache.find(key);
+    if (it != m_cache.end())
+      result = it->second;
+  }
+
+  if (!result.ran && !LoadCached(key, &result))
+  {
+    // Each compile gets its own output directory, so students can't trip over
+    // each other's class files, and its own directory to run in.
+    std::string output = m_cacheDirectory + "/build-" + key;
+    std::string work = m_cacheDirectory + "/work-" + key;
+    RemoveTree(output);
+    RemoveTree(work);
+    wxMkdir(output);
+    wxMkdir(work);
+
+    std::string command = BuildCommand(m_part.compileCommand, directory, files, output);
+    sProcessResult process;
+    if (!m_launcher.Run(command, work, "", COMPILE_SECONDS, 0, &process))
+      result.output = "I couldn't run " + command;
+    else
+    {
+      result.ran = true;
+      result.status = process.status;
+      result.output = process.output;
+
+      if (process.timedOut)
+        result.output += wxString::Format("\n(It was stopped after %d seconds.)\n", COMPILE_SECONDS).c_str();
+      else if (process.truncated)
+        result.output += wxString::Format("\n(It was stopped after printing %u KB.)\n",
+          (unsigned int)(GradingLauncher::MAX_OUTPUT >> 10)).c_str();
+      if ((process.timedOut || process.truncated) && result.status == 0)
+        result.status = -1;
+    }
+
+    RemoveTree(output);
+    RemoveTree(work);
+
+    // Running out of time might just mean the machine was busy, so that's not
+    // remembered, and they're tried again next time.
+    if (result.ran && process.timedOut)
+      key.clear();
+    else if (result.ran)
+      SaveCached(key, result);
+  }
+
+  Finish(directory, key, result);
+}
+
+void GradingCompiler::Finish(std::string directory, std::string key, const sCompileResult &result)
+{
+  {
+    wxMutexLocker lock(m_mutex);
+
+    if (!key.empty() && result.ran)
+      m_cache[key] = result;
+    m_results[directory] = result;
+
+    std::vector<std::string>::iterator it = std::find(m_working.begin(), m_working.end(), directory);
+    if (it != m_working.end())
+      m_working.erase(it);
+  }
+
+  wxCommandEvent e(wxEVT_GRADING_COMPILED);
+  e.SetString(directory.c_str());
+  wxPostEvent(m_handler, e);
+}
+
+bool GradingCompiler::ListSubmissions(std::string directory, std::vector<std::string> *files) const
+{
+  sPartFiles found;
+  if (m_manifest && m_manifest->GetPartFiles(directory, m_part, &found))
+  {
+    files->swap(found.submissions);
+    return true;
+  }
+
+  wxDir dir(directory);
+  if (!dir.IsOpened())
+    return false;
+
+  wxString filename;
+  bool more = dir.GetFirst(&filename, m_part.submissionFilter, wxDIR_FILES);
+  while (more)
+  {
+    files->push_back(filename.c_str());
+    more = dir.GetNext(&filename);
+  }
+
+  return true;
+}
+
+// The key covers the command, the directory (compilers put paths in their
+// messages) and every submission's name and contents. It's two differently
+// seeded hashes of all that, which is plenty to tell one roster's inputs apart.
+std::string GradingCompiler::HashInputs(std::string directory, const std::vector<std::string> &files) const
+{
+  std::string inputs = m_part.compileCommand + '\n' + directory + '\n';
+
+  for (size_t i = 0; i < files.size(); i++)
+  {
+    // The manifest usually hashed it already, when it was listed.
+    unsigned int hash = 0;
+    unsigned long size = 0;
+    if (!m_manifest || !m_manifest->GetFileHash(directory, files[i], &hash, &size))
+    {
+      GradingFileView view;
+      if (view.Open(directory + '/' + files[i]))
+      {
+        hash = HashContent(view.GetData(), view.GetLength());
+        size = view.GetLength();
+      }
+    }
+
+    inputs += files[i] + wxString::Format("\t%08x\t%lu\n", hash, size).c_str();
+  }
+
+  std::string salted = "compile\n" + inputs;
+  return wxString::Format("%08x%08x", HashContent(inputs.c_str(), inputs.length()),
+    HashContent(salted.c_str(), salted.length())).c_str();
+}
+
+// Cached results are the exit status on the first line and the output after it.
+bool GradingCompiler::LoadCached(std::string key, sCompileResult *result) const
+{
+  GradingFileView view;
+  if (!view.Open(m_cacheDirectory + '/' + key + ".txt"))
+    return false;
+
+  std::string content(view.GetData(), view.GetLength());
+  size_t newline = content.find('\n');
+  if (content.compare(0, 7, "status ") != 0 || newline == std::string::npos)
+    return false;
+
+  result->ran = true;
+  result->status = atoi(content.c_str() + 7);
+  result->output = content.substr(newline + 1);
+  return true;
+}
+
+void GradingCompiler::SaveCached(std::string key, const sCompileResult &result) const
+{
+  std::string content = wxString::Format("status %d\n", result.status).c_str();
+  WriteFileAtomically(m_cacheDirectory + '/' + key + ".txt", content + result.output);
+}
+
+void GradingCompiler::RemoveTree(std::string directory)
+{
+  // Everything's found first, and the listing closed, since removing files
+  // while they're being listed doesn't go well everywhere.
+  std::vector<std::string> files, directories;
+  {
+    wxDir dir(directory);
+    if (!dir.IsOpened())
+      return;
+
+    wxString filename;
+    bool more = dir.GetFirst(&filename, "", wxDIR_FILES | wxDIR_HIDDEN);
+    while (more)
+    {
+      files.push_back(directory + '/' + filename.c_str());
+      more = dir.GetNext(&filename);
+    }
+
+    more = dir.GetFirst(&filename, "", wxDIR_DIRS | wxDIR_HIDDEN);
+    while (more)
+    {
+      directories.push_back(directory + '/' + filename.c_str());
+      more = dir.GetNext(&filename);
+    }
+  }
+
+  for (size_t i = 0; i < files.size(); i++)
+    wxRemoveFile(files[i]);
+  for (size_t i = 0; i < directories.size(); i++)
+    RemoveTree(directories[i]);
+
+  wxRmdir(directory);
+}
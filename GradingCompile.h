@@ -0,0 +1,103 @@
+#ifndef GRADINGCOMPILE_H
+#define GRADINGCOMPILE_H
+
+#include <wx/event.h>
+#include <wx/thread.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+#include "GradingLauncher.h"
+#include "GradingManifest.h"
+
+// Sent to the compiler's handler whenever a student's result is ready. The
+// event's string is their directory.
+BEGIN_DECLARE_EVENT_TYPES()
+  DECLARE_EVENT_TYPE(wxEVT_GRADING_COMPILED, -1)
+END_DECLARE_EVENT_TYPES()
+
+struct sCompileResult
+{
+  bool ran;            // False if the command couldn't be started at all.
+  int status;          // The command's exit status; 0 means it compiled.
+  std::string output;  // Everything it printed, errors and all.
+};
+
+// The compiler runs the part's compile command on every student's submissions
+// in the background, a few at a time, so whether their code compiles is
+// already known by the time they're opened. The command comes from the
+// "compile:" line in parts_conf.txt, with %f replaced by the submissions
+// (quoted, with their full paths), %o by an empty directory for the output
+// and %d by the student's directory, e.g.
+//
+//   compile: javac -nowarn -d %o %f
+//
+// Results are kept by a hash of the command and everything in the submissions,
+// in memory and in the user's data directory, so a student whose files haven't
+// changed is never compiled again, even in another session. Students are
+// handed out in the order they were added, except that Hurry puts one at the
+// front of the line.
+//
+// Commands are run through a GradingLauncher rather than wxExecute, which can
+// only be used from the main thread, each in a work directory of its own.
+// They're stopped if they take longer than a couple of minutes or print more
+// than the launcher keeps, so a compiler that hangs can't hold up Stop (and
+// closing the roster) for good.
+
+class GradingCompiler
+{
+  public:
+  GradingCompiler(wxEvtHandler *handler, const sAssignmentPart &part, GradingManifest *manifest = NULL);
+  ~GradingCompiler();
+
+  void Start(int threads = 0);
+  void Stop();
+
+  void Add(std::string directory);
+  void Hurry(std::string directory);
+  bool GetResult(std::string directory, sCompileResult *result) const;
+
+  static std::string BuildCommand(std::string command, std::string directory, const std::vector<std::string> &files,
+    std::string output);
+  static void RemoveTree(std::string directory);
+
+  protected:
+  class Worker: public wxThread
+  {
+    public:
+    Worker(GradingCompiler *compiler);
+
+    protected:
+    GradingCompiler *m_compiler;
+
+    ExitCode Entry();
+  };
+
+  wxEvtHandler *m_handler;
+  sAssignmentPart m_part;
+  GradingManifest *m_manifest;
+  std::string m_cacheDirectory;
+  GradingLauncher m_launcher;
+
+  mutable wxMutex m_mutex;
+  wxCondition m_condition;
+  std::deque<std::string> m_queue;
+  std::vector<std::string> m_working;
+  std::map<std::string, sCompileResult> m_cache;    // By the hash of the inputs.
+  std::map<std::string, sCompileResult> m_results;  // Each directory's latest.
+  std::vector<Worker *> m_workers;
+  bool m_stop;
+
+  bool NextJob(std::string *directory);
+  void Compile(std::string directory);
+  void Finish(std::string directory, std::string key, const sCompileResult &result);
+
+  bool ListSubmissions(std::string directory, std::vector<std::string> *files) const;
+  std::string HashInputs(std::string directory, const std::vector<std::string> &files) const;
+  bool LoadCached(std::string key, sCompileResult *result) const;
+  void SaveCached(std::string key, const sCompileResult &result) const;
+};
+
+#endif
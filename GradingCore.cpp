@@ -0,0 +1,1788 @@
+
+#include "GradingCore.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <map>
+
+// This used to hand back a static buffer, which stopped being okay once the
+// batch tools started printing sheets from several threads at once.
+std::string formatFloat(float x)
+{
+  char s[32];
+
+  if (fabsf(x) - (int)fabsf(x) < 0.01f)
+    sprintf(s, "%d", (int)x);
+  else if (fabsf(x) - (int)fabsf(x) < 0.1f)
+    sprintf(s, "%.2f", x);
+  else
+    sprintf(s, "%.1f", x);
+
+  return s;
+}
+
+//-----GradingFileView-----
+
+GradingFileView::GradingFileView()
+{
+  m_data = NULL;
+  m_length = 0;
+  m_opened = false;
+#ifdef _WIN32
+  m_file = INVALID_HANDLE_VALUE;
+  m_mapping = NULL;
+#endif
+}
+
+GradingFileView::GradingFileView(std::string filename)
+{
+  m_data = NULL;
+  m_length = 0;
+  m_opened = false;
+#ifdef _WIN32
+  m_file = INVALID_HANDLE_VALUE;
+  m_mapping = NULL;
+#endif
+
+  Open(filename);
+}
+
+GradingFileView::~GradingFileView()
+{
+  Close();
+}
+
+bool GradingFileView::Open(std::string filename)
+{
+  Close();
+
+#ifdef _WIN32
+  m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (m_file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_file, &size))
+  {
+    Close();
+    return false;
+  }
+  m_length = (size_t)size.QuadPart;
+
+  // Empty files can't be mapped, but they're still perfectly good files.
+  if (m_length > 0)
+  {
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping == NULL)
+    {
+      Close();
+      return false;
+    }
+
+    m_data = (const char *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_data == NULL)
+    {
+      Close();
+      return false;
+    }
+  }
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return false;
+  }
+  m_length = st.st_size;
+
+  // Empty files can't be mapped, but they're still perfectly good files.
+  if (m_length > 0)
+  {
+    void *data = mmap(NULL, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      close(fd);
+      m_length = 0;
+      return false;
+    }
+    m_data = (const char *)data;
+  }
+
+  close(fd);
+#endif
+
+  m_opened = true;
+  return true;
+}
+
+void GradingFileView::Close()
+{
+#ifdef _WIN32
+  if (m_data != NULL)
+    UnmapViewOfFile(m_data);
+  if (m_mapping != NULL)
+    CloseHandle(m_mapping);
+  if (m_file != INVALID_HANDLE_VALUE)
+    CloseHandle(m_file);
+  m_file = INVALID_HANDLE_VALUE;
+  m_mapping = NULL;
+#else
+  if (m_data != NULL)
+    munmap((void *)m_data, m_length);
+#endif
+
+  m_data = NULL;
+  m_length = 0;
+  m_opened = false;
+}
+
+bool GradingFileView::IsOpened() const
+{
+  return m_opened;
+}
+
+const char *GradingFileView::GetData() const
+{
+  return m_data;
+}
+
+size_t GradingFileView::GetLength() const
+{
+  return m_length;
+}
+
+// Mapping a file doesn't read anything until it's looked at. This looks at every
+// page, so whoever calls it (the prefetcher, say) pays for the reading up front.
+void GradingFileView::Touch() const
+{
+  volatile char sink = 0;
+
+  for (size_t i = 0; i < m_length; i += 4096)
+    sink ^= m_data[i];
+  if (m_length > 0)
+    sink ^= m_data[m_length - 1];
+}
+
+//-----Atomic writes-----
+
+// Writes the whole file under a temporary name next to it, then renames it over
+// the real one, so a crash halfway through leaves the old file alone instead of
+// a truncated one. Files are written in text mode, like they always were.
+bool WriteFileAtomically(std::string filename, const std::string &content)
+{
+  std::string temp = filename + ".tmp";
+
+  FILE *f = fopen(temp.c_str(), "w");
+  if (f == NULL)
+    return false;
+
+  bool ok = fwrite(content.c_str(), sizeof(char), content.length(), f) == content.length();
+  ok = (fflush(f) == 0) && ok;
+#ifndef _WIN32
+  ok = (fsync(fileno(f)) == 0) && ok;
+#endif
+  ok = (fclose(f) == 0) && ok;
+
+#ifdef _WIN32
+  ok = ok && MoveFileExA(temp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+  ok = ok && rename(temp.c_str(), filename.c_str()) == 0;
+#endif
+
+  if (!ok)
+    remove(temp.c_str());
+
+  return ok;
+}
+
+//-----GradingString-----
+
+GradingString::GradingString():
+  m_precedes(0)
+{
+}
+
+GradingString::GradingString(std::string text, int precedes):
+  m_text(text),
+  m_precedes(precedes)
+{
+}
+
+GradingString::GradingString(const GradingString &s)
+{
+  *this = s;
+}
+
+GradingString &GradingString::operator=(const GradingString &s)
+{
+  m_text = s.m_text;
+  m_precedes = s.m_precedes;
+
+  return *this;
+}
+
+std::string GradingString::Print(float total, float max) const
+{
+  std::stringstream ssIn(m_text);
+  std::stringstream ssOut;
+
+  bool notFirst = false;
+  while (ssIn.good())
+  {
+    std::string tok;
+    getline(ssIn, tok, '%');
+    if (notFirst)
+    {
+      if (tok[0] == 't')
+        ssOut << formatFloat(total) << tok.substr(1);
+      else if (tok[0] == 'm')
+        ssOut << formatFloat(max) << tok.substr(1);
+    }
+    else
+      ssOut << tok;
+    notFirst = true;
+  }
+
+  return ssOut.str();
+}
+
+std::string GradingString::ToString() const
+{
+  return "STR " + m_text;
+}
+
+//-----GradingBoxSet-----
+
+static const size_t s_wordBits = sizeof(unsigned int) * 8;
+
+static int CountBits(unsigned int word)
+{
+#ifdef __GNUC__
+  return __builtin_popcount(word);
+#else
+  int count = 0;
+  for (; word != 0; word &= word - 1)
+    count++;
+  return count;
+#endif
+}
+
+GradingBoxSet::GradingBoxSet()
+{
+  m_size = 0;
+}
+
+GradingBoxSet::GradingBoxSet(size_t size)
+{
+  Assign(size);
+}
+
+// Resizes the set to the given number of boxes, none of them applied.
+void GradingBoxSet::Assign(size_t size)
+{
+  m_size = size;
+  m_words.assign((size + s_wordBits - 1) / s_wordBits, 0);
+}
+
+size_t GradingBoxSet::GetSize() const
+{
+  return m_size;
+}
+
+bool GradingBoxSet::Get(size_t box) const
+{
+  return (m_words[box / s_wordBits] >> (box % s_wordBits)) & 1;
+}
+
+// Returns true if the box actually changed.
+bool GradingBoxSet::Set(size_t box, bool state)
+{
+  unsigned int &word = m_words[box / s_wordBits];
+  unsigned int bit = 1u << (box % s_wordBits);
+
+  if (((word & bit) != 0) == state)
+    return false;
+
+  word ^= bit;
+  return true;
+}
+
+// Counts the applied boxes in [first, first + count).
+int GradingBoxSet::Count(size_t first, size_t count) const
+{
+  if (count == 0)
+    return 0;
+
+  size_t last = first + count - 1;
+  size_t firstWord = first / s_wordBits, lastWord = last / s_wordBits;
+  unsigned int firstMask = ~0u << (first % s_wordBits);
+  unsigned int lastMask = ~0u >> (s_wordBits - 1 - last % s_wordBits);
+
+  if (firstWord == lastWord)
+    return CountBits(m_words[firstWord] & firstMask & lastMask);
+
+  int total = CountBits(m_words[firstWord] & firstMask);
+  for (size_t i = firstWord + 1; i < lastWord; i++)
+    total += CountBits(m_words[i]);
+  return total + CountBits(m_words[lastWord] & lastMask);
+}
+
+void GradingBoxSet::Swap(GradingBoxSet &set)
+{
+  m_words.swap(set.m_words);
+  std::swap(m_size, set.m_size);
+}
+
+// Unused bits are never set, so the words can be compared directly.
+bool GradingBoxSet::operator==(const GradingBoxSet &set) const
+{
+  return m_size == set.m_size && m_words == set.m_words;
+}
+
+bool GradingBoxSet::operator!=(const GradingBoxSet &set) const
+{
+  return !(*this == set);
+}
+
+//-----GradingDeduction-----
+
+GradingDeduction::GradingDeduction()
+{
+  m_label = "";
+  m_firstBox = 0;
+}
+
+GradingDeduction::GradingDeduction(std::string label)
+{
+  SetLabel(label);
+  m_firstBox = 0;
+}
+
+GradingDeduction::GradingDeduction(const GradingDeduction &d)
+{
+  *this = d;
+}
+
+GradingDeduction &GradingDeduction::operator=(const GradingDeduction &d)
+{
+  m_label = d.m_label;
+  m_mapping = d.m_mapping;
+  m_choices = d.m_choices;
+  m_firstBox = d.m_firstBox;
+
+  return *this;
+}
+
+void GradingDeduction::SetLabel(std::string label)
+{
+  // Vestigial template-generalizing code
+/*
+  if (label.find(":") != std::string::npos)
+  {
+    int ind = 0;
+    if ((ind = label.find(" or ")) != std::string::npos)
+      label.erase(ind, label.find_first_of(" ", ind + 4) - ind);
+    if ((ind = label.find_first_of("123456789")) != std::string::npos)
+      label[ind] = '#';
+  }
+*/
+  m_label = label;
+}
+
+// Simple deductions have exactly one box; umbrella deductions have one per choice.
+size_t GradingDeduction::GetBoxCount() const
+{
+  return (m_choices.size() > 0)?m_choices.size():1;
+}
+
+void GradingDeduction::SetMapping(int index, float value)
+{
+  index--;
+
+  if ((unsigned int)index >= m_mapping.size())
+    m_mapping.resize(index + 1, (m_mapping.size() > 0)?m_mapping[m_mapping.size() - 1]:0.0f);
+
+  m_mapping[index] = value;
+}
+
+// Returns what this deduction is worth with the given number of its boxes applied.
+float GradingDeduction::GetValue(int applied) const
+{
+  int t = applied;
+
+  if (t == 0)
+    return 0.0f;
+
+  t--;
+
+  if (m_mapping.size() <= t)
+    return m_mapping[m_mapping.size() - 1];
+
+  return m_mapping[t];
+}
+
+float GradingDeduction::GetMaxValue() const
+{
+  return m_mapping[m_mapping.size() - 1];
+}
+
+// Two deductions have the same structure if they'd get the same checkboxes,
+// whether or not the same ones are ticked.
+bool GradingDeduction::HasSameStructure(const GradingDeduction &d) const
+{
+  return m_label == d.m_label && m_mapping == d.m_mapping && m_choices == d.m_choices;
+}
+
+void GradingDeduction::AddChoice(std::string label)
+{
+  m_choices.push_back(label);
+}
+
+int GradingDeduction::CountApplied(const GradingBoxSet &applied) const
+{
+  return applied.Count(m_firstBox, GetBoxCount());
+}
+
+std::string GradingDeduction::Print(const GradingBoxSet &applied) const
+{
+  std::stringstream s;
+  float value = GetValue(CountApplied(applied));
+
+  if (value == 0.0f)
+    return "";
+
+  if (m_choices.size() == 0)
+    s << "  " << formatFloat(value) << " " << m_label << '\n';
+  else
+  {
+    std::string label = m_label;
+    //int ind = 0;
+    //if (t == 1 && label[ind = (label.find(":") - 1)] == 's')
+    //  label.erase(ind, 1);
+    //label[label.find_first_of("#")] = (char)(t + '0');
+    s << "  " << formatFloat(value) << " " << label << '\n';
+    for (unsigned int i = 0; i < m_choices.size(); i++)
+      if (applied.Get(m_firstBox + i))
+        s << "    " << m_choices[i] << '\n';
+  }
+
+  return s.str();
+}
+
+// Without a sheet to say otherwise, none of the boxes are applied. This is how
+// templates get written.
+std::string GradingDeduction::ToString() const
+{
+  return ToString(GradingBoxSet(m_firstBox + GetBoxCount()));
+}
+
+std::string GradingDeduction::ToString(const GradingBoxSet &applied) const
+{
+  std::stringstream str;
+  str << "\tDED ";
+
+  if (m_choices.size() == 0 && applied.Get(m_firstBox))
+    str << "[X] [";
+  else
+    str << "[O] [";
+
+  for (size_t i = 0; i < m_mapping.size(); i++)
+    str << m_mapping[i] << ((i < m_mapping.size() - 1)?", ":"");
+  str << "] " << m_label;
+
+  for (size_t i = 0; i < m_choices.size(); i++)
+    str << "\n\t\tCRT " << (applied.Get(m_firstBox + i)?"[X] ":"[O] ") << m_choices[i];
+
+  return str.str();
+}
+
+//-----GradingCategory-----
+
+GradingCategory::GradingCategory()
+{
+  m_value = 0.0f;
+  m_label = "";
+}
+
+GradingCategory::GradingCategory(float value, std::string label, std::vector<GradingDeduction> dedux)
+{
+  m_value = value;
+  m_label = label;
+  m_dedux = dedux;
+}
+
+GradingCategory::GradingCategory(const GradingCategory &c)
+{
+  *this = c;
+}
+
+GradingCategory &GradingCategory::operator=(const GradingCategory &c)
+{
+  m_value = c.m_value;
+  m_label = c.m_label;
+  m_dedux = c.m_dedux;
+
+  return *this;
+}
+
+bool GradingCategory::HasSameStructure(const GradingCategory &c) const
+{
+  if (m_value != c.m_value || m_label != c.m_label || m_dedux.size() != c.m_dedux.size())
+    return false;
+
+  for (size_t i = 0; i < m_dedux.size(); i++)
+    if (!m_dedux[i].HasSameStructure(c.m_dedux[i]))
+      return false;
+
+  return true;
+}
+
+void GradingCategory::AddDeduction(GradingDeduction d)
+{
+  m_dedux.push_back(d);
+}
+
+std::string GradingCategory::ToString() const
+{
+  std::stringstream str;
+  str << "CAT [" << m_value << "] " << m_label;
+  for (size_t i = 0; i < m_dedux.size(); i++)
+    str << "\n" << m_dedux[i].ToString();
+
+  return str.str();
+}
+
+std::string GradingCategory::ToString(const GradingBoxSet &applied) const
+{
+  std::stringstream str;
+  str << "CAT [" << m_value << "] " << m_label;
+  for (size_t i = 0; i < m_dedux.size(); i++)
+    str << "\n" << m_dedux[i].ToString(applied);
+
+  return str.str();
+}
+
+//-----GradingRubric-----
+
+// 32-bit FNV-1a; it only has to tell rubrics apart, not keep secrets.
+static unsigned int HashBytes(unsigned int hash, const void *data, size_t length)
+{
+  const unsigned char *bytes = (const unsigned char *)data;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+// Labels are hashed with their terminators, so "ab" + "c" differs from "a" + "bc".
+static unsigned int HashString(unsigned int hash, const std::string &s)
+{
+  return HashBytes(hash, s.c_str(), s.length() + 1);
+}
+
+// Good enough to notice that a file changed, which is all anything uses it for.
+unsigned int HashContent(const char *data, size_t length)
+{
+  return HashBytes(2166136261u, data, length);
+}
+
+GradingRubric::GradingRubric()
+{
+  m_maxPoints = 0.0f;
+  m_boxCount = 0;
+  m_hash = 0;
+}
+
+// Compile lays out every deduction's boxes one after another, works out the
+// maximum points and hashes the whole thing. It has to be called once the
+// rubric is filled in, and the rubric shouldn't change after that.
+void GradingRubric::Compile()
+{
+  m_boxCount = 0;
+  for (size_t i = 0; i < m_categories.size(); i++)
+  {
+    for (size_t j = 0; j < m_categories[i].m_dedux.size(); j++)
+    {
+      m_categories[i].m_dedux[j].m_firstBox = m_boxCount;
+      m_boxCount += m_categories[i].m_dedux[j].GetBoxCount();
+    }
+  }
+
+  m_maxPoints = 0;
+  for (size_t i = 0; i + 1 < m_categories.size(); i++)
+    m_maxPoints += m_categories[i].m_value;
+
+  // Hashed field by field rather than through ToString, which would cost more
+  // than the parse did.
+  m_hash = 2166136261u;
+  for (size_t i = 0; i < m_strings.size(); i++)
+  {
+    m_hash = HashString(m_hash, m_strings[i].m_text);
+    m_hash = HashBytes(m_hash, &m_strings[i].m_precedes, sizeof(m_strings[i].m_precedes));
+  }
+  for (size_t i = 0; i < m_categories.size(); i++)
+  {
+    const GradingCategory &cat = m_categories[i];
+    m_hash = HashString(m_hash, cat.m_label);
+    m_hash = HashBytes(m_hash, &cat.m_value, sizeof(cat.m_value));
+    for (size_t j = 0; j < cat.m_dedux.size(); j++)
+    {
+      const GradingDeduction &ded = cat.m_dedux[j];
+      m_hash = HashString(m_hash, ded.m_label);
+      if (ded.m_mapping.size() > 0)
+        m_hash = HashBytes(m_hash, &ded.m_mapping[0], ded.m_mapping.size() * sizeof(float));
+      for (size_t k = 0; k < ded.m_choices.size(); k++)
+        m_hash = HashString(m_hash, ded.m_choices[k]);
+      m_hash = HashBytes(m_hash, "", 1);
+    }
+  }
+}
+
+// Categories and deductions are matched up by their labels, and criteria are
+// their own labels.
+template <class T>
+static const std::string &LabelOf(const T &item)
+{
+  return item.m_label;
+}
+
+static const std::string &LabelOf(const std::string &item)
+{
+  return item;
+}
+
+// Finds the unclaimed item with the given label, trying the same position first
+// so that labels used more than once pair up in order. Returns -1 if there's
+// nothing left with that label.
+template <class T>
+static int FindByLabel(const std::vector<T> &items, const std::string &label, size_t position, std::vector<bool> *taken)
+{
+  if (position < items.size() && !(*taken)[position] && LabelOf(items[position]) == label)
+  {
+    (*taken)[position] = true;
+    return position;
+  }
+
+  for (size_t i = 0; i < items.size(); i++)
+  {
+    if (!(*taken)[i] && LabelOf(items[i]) == label)
+    {
+      (*taken)[i] = true;
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Pairs every item in one list with an item in the other by label. Unmatched
+// items get -1 in match, and taken says which of the other list's items were
+// used. When a label turns up a different number of times in the two lists,
+// which ones go together is only a guess, and those are marked ambiguous.
+template <class T>
+static void MatchByLabel(const std::vector<T> &from, const std::vector<T> &to, std::vector<int> *match, std::vector<bool> *taken, std::vector<bool> *ambiguous)
+{
+  taken->assign(to.size(), false);
+  match->resize(from.size());
+  for (size_t i = 0; i < from.size(); i++)
+    (*match)[i] = FindByLabel(to, LabelOf(from[i]), i, taken);
+
+  std::map<std::string, int> uses;
+  for (size_t i = 0; i < from.size(); i++)
+    uses[LabelOf(from[i])]++;
+  for (size_t i = 0; i < to.size(); i++)
+    uses[LabelOf(to[i])]--;
+
+  // Both lists have the label, so if the counts differ, one of them has it
+  // more than once.
+  ambiguous->assign(from.size(), false);
+  for (size_t i = 0; i < from.size(); i++)
+    (*ambiguous)[i] = (*match)[i] >= 0 && uses[LabelOf(from[i])] != 0;
+}
+
+// Takes the point values from another rubric, usually an edited template, for
+// every category and deduction that's also in it. Categories and deductions are
+// matched by label, and by position between ones with the same label. A
+// deduction only matches if its criteria are all the same, in the same order,
+// so the boxes stay where they were. Returns how many deductions didn't match
+// and kept their old values. The rubric is compiled again afterwards, so this
+// is for a copy that isn't shared yet.
+int GradingRubric::TakeValues(const GradingRubric &rubric)
+{
+  int unmatched = 0;
+  std::vector<bool> takenCategories(rubric.m_categories.size(), false);
+
+  for (size_t i = 0; i < m_categories.size(); i++)
+  {
+    GradingCategory &cat = m_categories[i];
+    int c = FindByLabel(rubric.m_categories, cat.m_label, i, &takenCategories);
+    if (c < 0)
+    {
+      unmatched += cat.m_dedux.size();
+      continue;
+    }
+
+    const GradingCategory &from = rubric.m_categories[c];
+    cat.m_value = from.m_value;
+
+    std::vector<bool> taken(from.m_dedux.size(), false);
+    for (size_t j = 0; j < cat.m_dedux.size(); j++)
+    {
+      int d = FindByLabel(from.m_dedux, cat.m_dedux[j].m_label, j, &taken);
+      if (d < 0 || from.m_dedux[d].m_choices != cat.m_dedux[j].m_choices)
+      {
+        unmatched++;
+        continue;
+      }
+
+      cat.m_dedux[j].m_mapping = from.m_dedux[d].m_mapping;
+    }
+  }
+
+  Compile();
+  return unmatched;
+}
+
+// Strings don't show up in the panel, so they don't count here.
+bool GradingRubric::HasSameStructure(const GradingRubric &rubric) const
+{
+  if (m_categories.size() != rubric.m_categories.size())
+    return false;
+
+  for (size_t i = 0; i < m_categories.size(); i++)
+    if (!m_categories[i].HasSameStructure(rubric.m_categories[i]))
+      return false;
+
+  return true;
+}
+
+// Whether the two rubrics would be written out exactly the same.
+bool GradingRubric::IsSameRubric(const GradingRubric &rubric) const
+{
+  if (m_hash != rubric.m_hash || m_strings.size() != rubric.m_strings.size())
+    return false;
+
+  for (size_t i = 0; i < m_strings.size(); i++)
+    if (m_strings[i].m_text != rubric.m_strings[i].m_text || m_strings[i].m_precedes != rubric.m_strings[i].m_precedes)
+      return false;
+
+  return HasSameStructure(rubric);
+}
+
+std::string GradingRubric::ToString() const
+{
+  std::stringstream f;
+
+  unsigned int strInd = 0;
+  for (size_t i = 0; i < m_categories.size(); i++)
+  {
+    while (strInd < m_strings.size() && m_strings[strInd].m_precedes <= i)
+      f << m_strings[strInd++].ToString() << "\n";
+    f << m_categories[i].ToString() << "\n";
+  }
+
+  while (strInd < m_strings.size())
+    f << m_strings[strInd++].ToString() << "\n";
+
+  return f.str();
+}
+
+//-----GradingRubricCache-----
+
+GradingRubricCache::GradingRubricCache()
+{
+}
+
+GradingRubricCache::~GradingRubricCache()
+{
+  for (size_t i = 0; i < m_rubrics.size(); i++)
+    delete m_rubrics[i];
+}
+
+// Takes ownership of the rubric, and returns the cached copy of it. That's the
+// same pointer unless an identical rubric was already there, in which case the
+// new one is deleted.
+const GradingRubric *GradingRubricCache::Intern(GradingRubric *rubric)
+{
+  for (size_t i = 0; i < m_rubrics.size(); i++)
+  {
+    if (m_rubrics[i]->IsSameRubric(*rubric))
+    {
+      delete rubric;
+      return m_rubrics[i];
+    }
+  }
+
+  m_rubrics.push_back(rubric);
+  return rubric;
+}
+
+//-----GradingSheet-----
+
+std::string sParseError::ToString() const
+{
+  if (line == 0)
+    return message;
+
+  std::stringstream s;
+  s << "line " << line << ", column " << column << ": " << message;
+  return s.str();
+}
+
+static const GradingRubric s_emptyRubric;
+
+GradingSheet::GradingSheet()
+{
+  m_rubric = &s_emptyRubric;
+  m_ownRubric = NULL;
+  m_totalPoints = 0.0f;
+}
+
+GradingSheet::GradingSheet(const GradingRubric *rubric)
+{
+  m_rubric = &s_emptyRubric;
+  m_ownRubric = NULL;
+  m_totalPoints = 0.0f;
+
+  SetRubric(rubric);
+}
+
+GradingSheet::GradingSheet(const GradingSheet &s)
+{
+  m_rubric = &s_emptyRubric;
+  m_ownRubric = NULL;
+
+  *this = s;
+}
+
+GradingSheet::~GradingSheet()
+{
+  delete m_ownRubric;
+}
+
+GradingSheet &GradingSheet::operator=(const GradingSheet &s)
+{
+  if (this == &s)
+    return *this;
+
+  delete m_ownRubric;
+  m_ownRubric = NULL;
+
+  if (s.m_ownRubric != NULL)
+    m_rubric = m_ownRubric = new GradingRubric(*s.m_ownRubric);
+  else
+    m_rubric = s.m_rubric;
+
+  m_applied = s.m_applied;
+  m_notes = s.m_notes;
+  m_pending = s.m_pending;
+  m_totalPoints = s.m_totalPoints;
+
+  return *this;
+}
+
+const GradingRubric *GradingSheet::GetRubric() const
+{
+  return m_rubric;
+}
+
+const std::vector<GradingCategory> &GradingSheet::GetCategories() const
+{
+  return m_rubric->m_categories;
+}
+
+float GradingSheet::GetMaxPoints() const
+{
+  return m_rubric->m_maxPoints;
+}
+
+bool GradingSheet::Load(std::string filename, sParseError *error)
+{
+  GradingFileView view;
+  if (!view.Open(filename))
+  {
+    if (error != NULL)
+    {
+      error->line = error->column = 0;
+      error->message = "couldn't open the file";
+    }
+    return false;
+  }
+
+  return Parse(view.GetData(), view.GetLength(), error);
+}
+
+// Starts the sheet over on the given rubric, which has to outlive it, with
+// nothing applied and no notes. NULL leaves it with an empty rubric.
+void GradingSheet::SetRubric(const GradingRubric *rubric)
+{
+  delete m_ownRubric;
+  m_ownRubric = NULL;
+  m_rubric = (rubric != NULL)?rubric:&s_emptyRubric;
+
+  m_applied.Assign(m_rubric->m_boxCount);
+  m_notes.clear();
+  m_pending.clear();
+
+  UpdateTotal();
+}
+
+// Regrades the sheet with another rubric's point values (see
+// GradingRubric::TakeValues), keeping the same boxes applied. Returns how many
+// of the sheet's deductions had nothing to match.
+int GradingSheet::TakeValues(const GradingRubric &rubric)
+{
+  GradingRubric *own = new GradingRubric(*m_rubric);
+  int unmatched = own->TakeValues(rubric);
+
+  delete m_ownRubric;
+  m_rubric = m_ownRubric = own;
+
+  UpdateTotal();
+  return unmatched;
+}
+
+static std::string Quote(const std::string &label)
+{
+  return "\"" + label + "\"";
+}
+
+// Moves the sheet onto a different rubric, usually a revised template, which has
+// to outlive it. Categories, deductions and criteria are matched up by label the
+// same way TakeValues does it, but here they can be added, removed or moved
+// around, and every applied box that can be found in the new rubric stays
+// applied. The notes come along as they are.
+void GradingSheet::Migrate(const GradingRubric *rubric, sMigration *migration)
+{
+  const std::vector<GradingCategory> &from = m_rubric->m_categories, &to = rubric->m_categories;
+  GradingBoxSet applied(rubric->m_boxCount);
+
+  migration->changes.clear();
+  migration->carried = 0;
+  migration->lost.clear();
+  migration->ambiguous.clear();
+
+  std::vector<int> catMatch;
+  std::vector<bool> catTaken, catAmbiguous;
+  MatchByLabel(from, to, &catMatch, &catTaken, &catAmbiguous);
+
+  for (size_t i = 0; i < from.size(); i++)
+  {
+    const GradingCategory &oldCat = from[i];
+    std::string catName = Quote(oldCat.m_label);
+
+    if (catMatch[i] < 0)
+    {
+      migration->changes.push_back("removed category " + catName);
+      for (size_t j = 0; j < oldCat.m_dedux.size(); j++)
+      {
+        const GradingDeduction &ded = oldCat.m_dedux[j];
+        for (size_t k = 0; k < ded.GetBoxCount(); k++)
+          if (m_applied.Get(ded.m_firstBox + k))
+            migration->lost.push_back(catName + " / " + Quote(ded.m_label) + (ded.m_choices.size() > 0?" / " + Quote(ded.m_choices[k]):""));
+      }
+      continue;
+    }
+
+    const GradingCategory &newCat = to[catMatch[i]];
+
+    std::vector<int> dedMatch;
+    std::vector<bool> dedTaken, dedAmbiguous;
+    MatchByLabel(oldCat.m_dedux, newCat.m_dedux, &dedMatch, &dedTaken, &dedAmbiguous);
+
+    for (size_t j = 0; j < oldCat.m_dedux.size(); j++)
+    {
+      const GradingDeduction &oldDed = oldCat.m_dedux[j];
+      std::string dedName = catName + " / " + Quote(oldDed.m_label);
+      bool guessed = catAmbiguous[i] || dedAmbiguous[j];
+
+      if (dedMatch[j] < 0)
+      {
+        migration->changes.push_back("removed " + Quote(oldDed.m_label) + " from " + catName);
+        for (size_t k = 0; k < oldDed.GetBoxCount(); k++)
+          if (m_applied.Get(oldDed.m_firstBox + k))
+            migration->lost.push_back(dedName + (oldDed.m_choices.size() > 0?" / " + Quote(oldDed.m_choices[k]):""));
+        continue;
+      }
+
+      const GradingDeduction &newDed = newCat.m_dedux[dedMatch[j]];
+
+      if (oldDed.m_choices.size() == 0 && newDed.m_choices.size() == 0)
+      {
+        if (m_applied.Get(oldDed.m_firstBox))
+        {
+          applied.Set(newDed.m_firstBox, true);
+          migration->carried++;
+          if (guessed)
+            migration->ambiguous.push_back(dedName);
+        }
+      }
+      else if (oldDed.m_choices.size() > 0 && newDed.m_choices.size() > 0)
+      {
+        std::vector<int> crtMatch;
+        std::vector<bool> crtTaken, crtAmbiguous;
+        MatchByLabel(oldDed.m_choices, newDed.m_choices, &crtMatch, &crtTaken, &crtAmbiguous);
+
+        for (size_t k = 0; k < oldDed.m_choices.size(); k++)
+        {
+          std::string crtName = dedName + " / " + Quote(oldDed.m_choices[k]);
+
+          if (crtMatch[k] < 0)
+            migration->changes.push_back("removed criterion " + Quote(oldDed.m_choices[k]) + " from " + dedName);
+
+          if (!m_applied.Get(oldDed.m_firstBox + k))
+            continue;
+
+          if (crtMatch[k] < 0)
+          {
+            migration->lost.push_back(crtName);
+            continue;
+          }
+
+          applied.Set(newDed.m_firstBox + crtMatch[k], true);
+          migration->carried++;
+          if (guessed || crtAmbiguous[k])
+            migration->ambiguous.push_back(crtName);
+        }
+
+        for (size_t k = 0; k < newDed.m_choices.size(); k++)
+          if (!crtTaken[k])
+            migration->changes.push_back("added criterion " + Quote(newDed.m_choices[k]) + " to " + dedName);
+      }
+      else if (oldDed.m_choices.size() > 0)
+      {
+        // Criteria folded into a single box: the box goes on if any of them
+        // were, but there's no telling if it's worth the same.
+        migration->changes.push_back(dedName + " went from criteria to a single box");
+        if (oldDed.CountApplied(m_applied) > 0)
+        {
+          applied.Set(newDed.m_firstBox, true);
+          migration->carried++;
+          migration->ambiguous.push_back(dedName);
+        }
+      }
+      else
+      {
+        // A single box split into criteria: there's no telling which one it was.
+        migration->changes.push_back(dedName + " went from a single box to criteria");
+        if (m_applied.Get(oldDed.m_firstBox))
+          migration->lost.push_back(dedName);
+      }
+    }
+
+    for (size_t j = 0; j < newCat.m_dedux.size(); j++)
+      if (!dedTaken[j])
+        migration->changes.push_back("added " + Quote(newCat.m_dedux[j].m_label) + " to " + catName);
+  }
+
+  for (size_t i = 0; i < to.size(); i++)
+    if (!catTaken[i])
+      migration->changes.push_back("added category " + Quote(to[i].m_label));
+
+  delete m_ownRubric;
+  m_ownRubric = NULL;
+  m_rubric = rubric;
+
+  m_applied.Swap(applied);
+  UpdateTotal();
+}
+
+// Swaps the sheet's own rubric for the cache's copy of it.
+void GradingSheet::Intern(GradingRubricCache *cache)
+{
+  if (m_ownRubric == NULL)
+    return;
+
+  m_rubric = cache->Intern(m_ownRubric);
+  m_ownRubric = NULL;
+}
+
+void GradingSheet::Clear()
+{
+  SetRubric(NULL);
+}
+
+void GradingSheet::Swap(GradingSheet &sheet)
+{
+  std::swap(m_rubric, sheet.m_rubric);
+  std::swap(m_ownRubric, sheet.m_ownRubric);
+  m_applied.Swap(sheet.m_applied);
+  m_notes.swap(sheet.m_notes);
+  m_pending.swap(sheet.m_pending);
+  std::swap(m_totalPoints, sheet.m_totalPoints);
+}
+
+bool GradingSheet::Parse(std::string content, sParseError *error)
+{
+  return Parse(content.c_str(), content.length(), error);
+}
+
+// The parser works straight off the content, one line at a time, without
+// copying the lines out of it. A line is just where it starts and ends.
+struct sSheetLine
+{
+  const char *begin;
+  const char *end;
+  int number;
+};
+
+// Finds the line starting at pos, leaving pos at the start of the one after it.
+// Like getline, a final newline means there's one more (empty) line, and
+// more is set to false once the end of the content has been reached.
+static void NextLine(const char *&pos, const char *end, sSheetLine *line, bool *more)
+{
+  const char *stop = (pos < end)?(const char *)memchr(pos, '\n', end - pos):NULL;
+
+  line->begin = pos;
+  line->number++;
+
+  if (stop == NULL)
+  {
+    stop = end;
+    pos = end;
+    *more = false;
+  }
+  else
+    pos = stop + 1;
+
+  // Windows line endings
+  if (stop > line->begin && stop[-1] == '\r')
+    stop--;
+
+  line->end = stop;
+}
+
+static bool ParseFailed(const sSheetLine &line, const char *at, const char *message, sParseError *error)
+{
+  if (error != NULL)
+  {
+    error->line = line.number;
+    error->column = at - line.begin + 1;
+    error->message = message;
+  }
+
+  return false;
+}
+
+static void SkipBlanks(const char *&p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+}
+
+static bool SkipWord(const char *&p, const char *end, const char *word)
+{
+  size_t length = strlen(word);
+
+  if ((size_t)(end - p) < length || memcmp(p, word, length) != 0)
+    return false;
+
+  p += length;
+  return true;
+}
+
+// Reads a number the way scanf's %f would. The content isn't null-terminated,
+// so the number is copied somewhere that is first; none of them are long.
+static bool ReadNumber(const char *&p, const char *end, float *value)
+{
+  char buffer[64];
+  size_t length = std::min((size_t)(end - p), sizeof(buffer) - 1);
+  char *stop;
+
+  memcpy(buffer, p, length);
+  buffer[length] = '\0';
+
+  double d = strtod(buffer, &stop);
+  if (stop == buffer)
+    return false;
+
+  *value = (float)d;
+  p += stop - buffer;
+  return true;
+}
+
+// Reads a "[X]" or "[O]" box, which is applied if the mark is an X.
+static bool ReadMark(const char *&p, const char *end, bool *applied)
+{
+  if (p == end || *p != '[')
+    return false;
+
+  const char *close = (const char *)memchr(p, ']', end - p);
+  if (close == NULL)
+    return false;
+
+  *applied = (p + 1 < close && p[1] == 'X');
+  p = close + 1;
+  return true;
+}
+
+// Labels run to the end of the line, after the space that ends the brackets.
+static void ReadLabel(const char *p, const char *end, std::string *label)
+{
+  if (p < end && *p == ' ')
+    p++;
+
+  label->assign(p, end - p);
+}
+
+struct sCheckboxIndex {int cat, ded, crt;};
+
+// Parse reads a template or .ss file in one pass. A sheet that doesn't make
+// sense leaves this one cleared, and says where it went wrong if asked to.
+//   CAT [value] label         - A category.
+//   \tDED [X] [v1, v2] label  - A deduction, with its point values.
+//   \t\tCRT [X] label         - One of an umbrella deduction's criteria.
+//   STR text                  - A string for the grade file.
+//   PENDING text              - A line of the test runner's findings.
+//   NOTES                     - Everything after this is the notes.
+// Anything else is skipped, which is how templates get away with having lines
+// for the other tools in them (see ReadTemplateExtras).
+bool GradingSheet::Parse(const char *content, size_t length, sParseError *error)
+{
+  const char *pos = content, *end = content + length;
+  bool more = true;
+  sSheetLine line = {NULL, NULL, 0};
+  GradingCategory *cat = NULL;
+  GradingDeduction *ded = NULL;
+
+  std::vector<sCheckboxIndex> onBoxes;
+  sCheckboxIndex cBox = {-1, -1, -1};
+
+  Clear();
+
+  GradingRubric *rubric = new GradingRubric();
+  std::vector<GradingCategory> &categories = rubric->m_categories;
+  std::string notes, pending;
+  bool ok = true;
+
+  while (ok && more)
+  {
+    NextLine(pos, end, &line, &more);
+
+    const char *p = line.begin;
+    while (p < line.end && *p == '\t')
+      p++;
+
+    // Blank lines don't mean anything
+    if (p == line.end)
+      continue;
+
+    // Category
+    if (line.begin[0] == 'C')
+    {
+      cBox.cat++;
+      cBox.ded = cBox.crt = -1;
+
+      categories.push_back(GradingCategory());
+      cat = &categories.back();
+      ded = NULL;
+
+      if (!SkipWord(p, line.end, "CAT"))
+        ok = ParseFailed(line, p, "expected CAT", error);
+      else
+      {
+        SkipBlanks(p, line.end);
+        if (p == line.end || *p != '[')
+          ok = ParseFailed(line, p, "expected '[' before the category's points", error);
+        else if (!ReadNumber(++p, line.end, &cat->m_value))
+          ok = ParseFailed(line, p, "expected the category's points", error);
+        else
+        {
+          SkipBlanks(p, line.end);
+          if (p == line.end || *p != ']')
+            ok = ParseFailed(line, p, "expected ']' after the category's points", error);
+          else
+            ReadLabel(p + 1, line.end, &cat->m_label);
+        }
+      }
+    }
+    // String, which ends the category before it
+    else if (line.begin[0] == 'S')
+    {
+      cat = NULL;
+      ded = NULL;
+
+      rubric->m_strings.push_back(GradingString("", categories.size()));
+      if (line.end - line.begin > 4)
+        rubric->m_strings.back().m_text.assign(line.begin + 4, line.end);
+    }
+    // Deduction
+    else if (*p == 'D')
+    {
+      cBox.ded++;
+      cBox.crt = -1;
+
+      if (cat == NULL)
+      {
+        ok = ParseFailed(line, p, "deduction isn't in a category", error);
+        continue;
+      }
+
+      cat->m_dedux.push_back(GradingDeduction());
+      ded = &cat->m_dedux.back();
+
+      bool applied;
+      float value;
+      int index = 1;
+
+      if (!SkipWord(p, line.end, "DED"))
+      {
+        ok = ParseFailed(line, p, "expected DED", error);
+        continue;
+      }
+
+      SkipBlanks(p, line.end);
+      if (!ReadMark(p, line.end, &applied))
+      {
+        ok = ParseFailed(line, p, "expected [X] or [O]", error);
+        continue;
+      }
+
+      // If this deduction is simple and applied, remember to check its box later
+      if (applied)
+      {
+        cBox.crt = 0;
+        onBoxes.push_back(cBox);
+      }
+
+      SkipBlanks(p, line.end);
+      if (p == line.end || *p != '[')
+        ok = ParseFailed(line, p, "expected '[' before the deduction's points", error);
+      else
+      {
+        p++;
+        while (ok)
+        {
+          if (!ReadNumber(p, line.end, &value))
+            ok = ParseFailed(line, p, "expected one of the deduction's points", error);
+          else
+          {
+            ded->SetMapping(index++, value);
+            SkipBlanks(p, line.end);
+            if (p < line.end && *p == ',')
+              p++;
+            else if (p < line.end && *p == ']')
+              break;
+            else
+              ok = ParseFailed(line, p, "expected ',' or ']' in the deduction's points", error);
+          }
+        }
+
+        if (ok)
+          ReadLabel(p + 1, line.end, &ded->m_label);
+      }
+    }
+    // Criterion
+    else if (*p == 'C')
+    {
+      cBox.crt++;
+
+      if (ded == NULL)
+      {
+        ok = ParseFailed(line, p, "criterion isn't under a deduction", error);
+        continue;
+      }
+
+      bool applied;
+
+      if (!SkipWord(p, line.end, "CRT"))
+      {
+        ok = ParseFailed(line, p, "expected CRT", error);
+        continue;
+      }
+
+      SkipBlanks(p, line.end);
+      if (!ReadMark(p, line.end, &applied))
+        ok = ParseFailed(line, p, "expected [X] or [O]", error);
+      else
+      {
+        ded->m_choices.push_back(std::string());
+        ReadLabel(p, line.end, &ded->m_choices.back());
+
+        // If this criterion is checked, remember to make it so later
+        if (applied)
+          onBoxes.push_back(cBox);
+      }
+    }
+    // The test runner's findings, which aren't part of the rubric
+    else if (line.begin[0] == 'P')
+    {
+      if (line.end - line.begin > 8)
+        pending.append(line.begin + 8, line.end);
+      pending += '\n';
+    }
+    // Notes
+    else if (*p == 'N')
+    {
+      while (more)
+      {
+        NextLine(pos, end, &line, &more);
+        notes.append(line.begin, line.end);
+        notes += '\n';
+      }
+    }
+  }
+
+  if (!ok)
+  {
+    delete rubric;
+    return false;
+  }
+
+  rubric->Compile();
+  m_rubric = m_ownRubric = rubric;
+  m_applied.Assign(rubric->m_boxCount);
+  m_notes.swap(notes);
+  m_pending.swap(pending);
+
+  // An applied umbrella deduction throws its criteria off by one, so the last
+  // one can land past the end of its boxes. Those were always lost, and they
+  // mustn't spill over into the next deduction's boxes now.
+  for (size_t i = 0; i < onBoxes.size(); i++)
+  {
+    const GradingDeduction &d = categories[onBoxes[i].cat].m_dedux[onBoxes[i].ded];
+    if ((size_t)onBoxes[i].crt < d.GetBoxCount())
+      m_applied.Set(d.m_firstBox + onBoxes[i].crt, true);
+  }
+
+  UpdateTotal();
+  return true;
+}
+
+bool GradingSheet::GetDeductionBox(int category, int deduction, int box) const
+{
+  return m_applied.Get(m_rubric->m_categories[category].m_dedux[deduction].m_firstBox + box);
+}
+
+// Applies or removes one box, adjusting the total by the difference it makes.
+// Only the one deduction's count changes, and that's just one more or one less
+// than before, so nothing else has to be looked at.
+void GradingSheet::SetDeductionBox(int category, int deduction, int box, bool state)
+{
+  const GradingDeduction &ded = m_rubric->m_categories[category].m_dedux[deduction];
+  if (!m_applied.Set(ded.m_firstBox + box, state))
+    return;
+
+  int after = ded.CountApplied(m_applied);
+  int before = state?after - 1:after + 1;
+
+  m_totalPoints -= ded.GetValue(before);
+  m_totalPoints += ded.GetValue(after);
+}
+
+float GradingSheet::GetDeductionValue(int category, int deduction) const
+{
+  const GradingDeduction &ded = m_rubric->m_categories[category].m_dedux[deduction];
+  return ded.GetValue(ded.CountApplied(m_applied));
+}
+
+// Recomputes the total from scratch, rather than one box at a time.
+void GradingSheet::UpdateTotal()
+{
+  const std::vector<GradingCategory> &categories = m_rubric->m_categories;
+
+  m_totalPoints = m_rubric->m_maxPoints;
+  for (size_t i = 0; i < categories.size(); i++)
+    for (size_t j = 0; j < categories[i].m_dedux.size(); j++)
+      m_totalPoints += GetDeductionValue(i, j);
+}
+
+// Strings and notes don't show up in the panel, so they don't count.
+bool GradingSheet::HasSameStructure(const GradingSheet &sheet) const
+{
+  if (m_rubric == sheet.m_rubric)
+    return true;
+
+  return m_rubric->HasSameStructure(*sheet.m_rubric);
+}
+
+// PrintGradeFile builds the grade file as it is meant to be returned to the student.
+std::string GradingSheet::PrintGradeFile() const
+{
+  const std::vector<GradingString> &strings = m_rubric->m_strings;
+  const std::vector<GradingCategory> &categories = m_rubric->m_categories;
+  float maxPoints = m_rubric->m_maxPoints;
+  std::string out;
+
+  if (categories.size() == 0)
+    return out;
+
+  unsigned int strInd = 0;
+  for (unsigned int i = 0; i < categories.size() - 1; i++)
+  {
+    while (strInd < strings.size() && strings[strInd].m_precedes <= i)
+      out += strings[strInd++].Print(m_totalPoints, maxPoints) + "\n";
+    out += categories[i].m_label + "\n";
+    for (unsigned int j = 0; j < categories[i].m_dedux.size(); j++)
+      out += categories[i].m_dedux[j].Print(m_applied);
+    out += "\n";
+  }
+
+  // Special case for no submission
+  if (categories.back().m_dedux.size() > 0 && GetDeductionValue(categories.size() - 1, 0) != 0.0f)
+  {
+    out += formatFloat(-maxPoints);
+    out += " " + categories[categories.size() - 1].m_dedux[0].m_label + "\n\n";
+  }
+
+  if (m_notes.length() > 0)
+    out += "Note: " + m_notes + "\n\n";
+
+  while (strInd < strings.size())
+    out += strings[strInd++].Print(m_totalPoints, maxPoints) + "\n";
+
+  return out;
+}
+
+// ToString records grading information in the same format as templates, with
+// applied deductions marked and notes included.
+std::string GradingSheet::ToString() const
+{
+  const std::vector<GradingString> &strings = m_rubric->m_strings;
+  const std::vector<GradingCategory> &categories = m_rubric->m_categories;
+  std::stringstream f;
+
+  unsigned int strInd = 0;
+  for (size_t i = 0; i < categories.size(); i++)
+  {
+    while (strInd < strings.size() && strings[strInd].m_precedes <= i)
+      f << strings[strInd++].ToString() << "\n";
+    f << categories[i].ToString(m_applied) << "\n";
+  }
+
+  while (strInd < strings.size())
+    f << strings[strInd++].ToString() << "\n";
+
+  // Each line of the findings gets its own PENDING.
+  size_t start = 0;
+  while (start < m_pending.length())
+  {
+    size_t stop = m_pending.find('\n', start);
+    if (stop == std::string::npos)
+      stop = m_pending.length();
+    f << "PENDING " << m_pending.substr(start, stop - start) << "\n";
+    start = stop + 1;
+  }
+
+  f << "\nNOTES\n" << m_notes;
+
+  return f.str();
+}
+
+bool GradingSheet::SaveGradeFile(std::string filename) const
+{
+  return WriteFileAtomically(filename, PrintGradeFile());
+}
+
+bool GradingSheet::SaveScoreFile(std::string filename) const
+{
+  return WriteFileAtomically(filename, ToString());
+}
+
+// Score sheets live next to the grade file, with the extension swapped for .ss.
+std::string GradingSheet::ScoreFilename(std::string gradeFilename)
+{
+  return gradeFilename.substr(0, gradeFilename.find_last_of('.')) + ".ss";
+}
+
+//-----Template extras-----
+
+// Every word the tools know. Anything else is almost certainly a typo, and a
+// test or rule that silently went missing is worse than a template that won't
+// load.
+static const char *const EXTRA_WORDS[] =
+{
+  "TST", "IN", "OUT", "RGX", "LIM",       // GradingTests
+  "HAS", "LACKS", "HASTEXT", "LACKSTEXT", "SIG", "SIGCHECK"  // GradingRules
+};
+
+// Reads the lines GradingSheet::Parse skips, keeping track of which box each
+// one is under the same way Parse counts them. Only lines from the top of the
+// file to NOTES are looked at.
+bool ReadTemplateExtras(std::string filename, std::vector<sTemplateExtra> *extras, sParseError *error)
+{
+  extras->clear();
+
+  GradingFileView view;
+  if (!view.Open(filename))
+  {
+    if (error != NULL)
+    {
+      error->line = error->column = 0;
+      error->message = "couldn't open the file";
+    }
+    return false;
+  }
+
+  const char *pos = view.GetData(), *end = pos + view.GetLength();
+  bool more = true;
+  sSheetLine line = {NULL, NULL, 0};
+  int category = -1, deduction = -1, criterion = -1;
+  bool boxed = false;  // Whether the last line was a box something can go under.
+
+  while (more)
+  {
+    NextLine(pos, end, &line, &more);
+
+    const char *p = line.begin;
+    while (p < line.end && *p == '\t')
+      p++;
+
+    if (p == line.end)
+      continue;
+
+    if (line.begin[0] == 'C')
+    {
+      category++;
+      deduction = criterion = -1;
+      boxed = false;
+    }
+    else if (line.begin[0] == 'S' || line.begin[0] == 'P')
+      boxed = false;
+    else if (*p == 'D')
+    {
+      deduction++;
+      criterion = -1;
+      boxed = true;
+    }
+    else if (*p == 'C')
+    {
+      criterion++;
+      boxed = true;
+    }
+    else if (*p == 'N')
+      break;
+    else
+    {
+      const char *space = (const char *)memchr(p, ' ', line.end - p);
+
+      sTemplateExtra extra;
+      extra.line = line.number;
+      extra.column = p - line.begin + 1;
+      extra.word.assign(p, (space != NULL)?space:line.end);
+      if (space != NULL)
+        extra.text.assign(space + 1, line.end);
+      extra.category = category;
+      extra.deduction = boxed?deduction:-1;
+      extra.criterion = boxed?criterion:-1;
+
+      size_t known = 0;
+      while (known < sizeof(EXTRA_WORDS) / sizeof(EXTRA_WORDS[0]) && extra.word != EXTRA_WORDS[known])
+        known++;
+      if (known == sizeof(EXTRA_WORDS) / sizeof(EXTRA_WORDS[0]))
+        return ParseFailed(line, p,
+          "expected a test (TST, IN, OUT, RGX, LIM) or rule (HAS, LACKS, HASTEXT, LACKSTEXT, SIG, SIGCHECK)", error);
+
+      extras->push_back(extra);
+    }
+  }
+
+  return true;
+}
+
+// Works out which of the rubric's boxes an extra line is under. Returns NULL if
+// it's under a box that can be checked by itself (a simple deduction, or one of
+// an umbrella deduction's criteria), or what's wrong if it isn't.
+const char *FindTemplateBox(const GradingRubric &rubric, const sTemplateExtra &extra, int *box, std::string *label)
+{
+  if (extra.category < 0 || extra.deduction < 0)
+    return "isn't under a deduction or criterion";
+
+  if ((size_t)extra.category >= rubric.m_categories.size() ||
+    (size_t)extra.deduction >= rubric.m_categories[extra.category].m_dedux.size())
+    return "doesn't match up with the template's boxes";
+
+  const GradingDeduction &ded = rubric.m_categories[extra.category].m_dedux[extra.deduction];
+  if (extra.criterion < 0 && ded.m_choices.size() > 0)
+    return "is under an umbrella deduction instead of one of its criteria";
+  if (extra.criterion >= (int)ded.m_choices.size())
+    return "doesn't match up with the template's boxes";
+
+  *box = (extra.criterion < 0)?0:extra.criterion;
+  *label = (extra.criterion < 0)?ded.m_label:ded.m_choices[extra.criterion];
+  return NULL;
+}
+
+//-----Assignment parts-----
+
+// Returns false if the file couldn't be read or looked malformed; whatever parts
+// could be made sense of are still added.
+bool LoadAssignmentParts(std::string filename, std::vector<sAssignmentPart> *parts)
+{
+  std::ifstream conf(filename.c_str(), std::ios::in);
+  std::string tok;
+  sAssignmentPart *part = NULL;
+  bool ok = conf.good();
+  while (conf.good())
+  {
+    conf >> tok;
+    if (tok[0] == '{')
+    {
+      sAssignmentPart p = {"[no name]", "*.*", "*.*", ""};
+      parts->push_back(p);
+      part = &(*parts)[parts->size() - 1];
+    }
+    else if (tok[0] != '}' && parts->size() == 0)
+      ok = false;
+
+    std::string *target = NULL;
+    if (part == NULL)
+      continue;
+    else if (tok == "name:")
+      target = &part->name;
+    else if (tok == "submissions:")
+      target = &part->submissionFilter;
+    else if (tok == "grade:")
+      target = &part->gradeFileFilter;
+    else if (tok == "compile:")
+      target = &part->compileCommand;
+
+    if (target == NULL)
+      continue;
+
+    getline(conf, *target);
+    size_t found = target->find_first_not_of(" \t");
+    if (found != std::string::npos)
+      *target = target->substr(found);
+    else
+      target->clear();
+  }
+
+  return ok;
+}
+
+// Parts can be given by name, or by their number in parts_conf.txt (starting
+// at 1). Returns -1 if there's no such part.
+int FindAssignmentPart(const std::vector<sAssignmentPart> &parts, std::string name)
+{
+  for (size_t i = 0; i < parts.size(); i++)
+    if (parts[i].name == name)
+      return i;
+
+  int number = atoi(name.c_str());
+  if (number > 0 && (size_t)number <= parts.size())
+    return number - 1;
+
+  return -1;
+}
@@ -0,0 +1,329 @@
+#ifndef GRADINGCORE_H
+#define GRADINGCORE_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// The grading core is the rubric model without any of the GUI attached. It
+// doesn't include anything from wxWidgets, so the batch tools can chew through
+// a whole roster of score sheets without ever creating a widget.
+
+std::string formatFloat(float x);
+
+// A file view maps a whole file into memory read-only, so the parser and the
+// text pages can read it in place instead of copying it into a buffer first.
+// Files are kept exactly as they are on disk, so readers should expect "\r\n"
+// line endings from Windows editors.
+
+class GradingFileView
+{
+  public:
+  GradingFileView();
+  GradingFileView(std::string filename);
+  ~GradingFileView();
+
+  bool Open(std::string filename);
+  void Close();
+
+  bool IsOpened() const;
+  const char *GetData() const;
+  size_t GetLength() const;
+
+  void Touch() const;
+
+  protected:
+  const char *m_data;
+  size_t m_length;
+  bool m_opened;
+#ifdef _WIN32
+  void *m_file;
+  void *m_mapping;
+#endif
+
+  private:
+  GradingFileView(const GradingFileView &);
+  GradingFileView &operator=(const GradingFileView &);
+};
+
+bool WriteFileAtomically(std::string filename, const std::string &content);
+unsigned int HashContent(const char *data, size_t length);
+
+// Strings are simply put into the output grade file literally, with a few
+// bells and whistles for formatting.
+//   %t - Replaced with the student's total earned points.
+//   %m - Replaced with the assignment's maximum point value.
+
+class GradingString
+{
+  public:
+  GradingString();
+  GradingString(std::string text, int precedes);
+  GradingString(const GradingString &s);
+
+  GradingString &operator=(const GradingString &s);
+
+  std::string m_text;
+
+  // The 'precedes' value indicates which category (by index) this
+  // string should immediately precede in the output. If two strings
+  // have the same value, they are written in the order they were
+  // read from the template.
+  int m_precedes;
+
+  std::string Print(float total, float max) const;
+  std::string ToString() const;
+};
+
+// A box set holds which boxes on a sheet are applied, one bit per box, packed
+// into words so a deduction's boxes can be counted a word at a time. Boxes are
+// numbered the way the compiled rubric lays them out.
+
+class GradingBoxSet
+{
+  public:
+  GradingBoxSet();
+  GradingBoxSet(size_t size);
+
+  void Assign(size_t size);
+  size_t GetSize() const;
+
+  bool Get(size_t box) const;
+  bool Set(size_t box, bool state);
+  int Count(size_t first, size_t count) const;
+
+  void Swap(GradingBoxSet &set);
+
+  bool operator==(const GradingBoxSet &set) const;
+  bool operator!=(const GradingBoxSet &set) const;
+
+  protected:
+  std::vector<unsigned int> m_words;
+  size_t m_size;
+};
+
+// Deductions are the components of the grade that subtract points. Each one
+// has a condition and a point value; the understanding is that when the condition
+// is met, the (usually negative) point value is added to the student's score.
+// Which of a deduction's boxes are ticked is up to each student's sheet; the
+// deduction itself only knows where its boxes start in the sheet.
+
+class GradingDeduction
+{
+  public:
+  GradingDeduction();
+  GradingDeduction(std::string label);
+  GradingDeduction(const GradingDeduction &d);
+
+  GradingDeduction &operator=(const GradingDeduction &d);
+
+  std::string m_label;
+  std::vector<std::string> m_choices; // For umbrella deductions.
+  std::vector<float> m_mapping;       // The mapping from number of flaws to points taken off.
+  size_t m_firstBox;                  // Where this deduction's boxes start in a sheet.
+
+  void SetLabel(std::string label);
+  size_t GetBoxCount() const;
+  void SetMapping(int index, float value);
+  float GetValue(int applied) const;
+  float GetMaxValue() const;
+
+  bool HasSameStructure(const GradingDeduction &d) const;
+
+  void AddChoice(std::string label);
+  std::string Print(const GradingBoxSet &applied) const;
+
+  std::string ToString() const;
+  std::string ToString(const GradingBoxSet &applied) const;
+
+  int CountApplied(const GradingBoxSet &applied) const;
+};
+
+// Categories are the level up from deductions. They have a description and total
+// point value, and house any number of deductions that are relevant. These would
+// usually be problems in an assignment, or pieces of particularly large problems.
+
+class GradingCategory
+{
+  public:
+  GradingCategory();
+  GradingCategory(float value, std::string label, std::vector<GradingDeduction> dedux);
+  GradingCategory(const GradingCategory &c);
+
+  GradingCategory &operator=(const GradingCategory &c);
+
+  std::vector<GradingDeduction> m_dedux;
+  std::string m_label;
+  float m_value;
+
+  bool HasSameStructure(const GradingCategory &c) const;
+
+  void AddDeduction(GradingDeduction d);
+
+  std::string ToString() const;
+  std::string ToString(const GradingBoxSet &applied) const;
+};
+
+// A rubric is everything a template or .ss file says about how to grade: the
+// strings and categories, in order. The last category is always the special
+// 'no submission' one. Once compiled, a rubric isn't changed again, so every
+// student graded with the same one can share it.
+
+class GradingRubric
+{
+  public:
+  GradingRubric();
+
+  std::vector<GradingString> m_strings;
+  std::vector<GradingCategory> m_categories;
+
+  float m_maxPoints;
+  size_t m_boxCount;
+  unsigned int m_hash;  // Of the rubric as it would be written to a template.
+
+  void Compile();
+  int TakeValues(const GradingRubric &rubric);
+
+  bool HasSameStructure(const GradingRubric &rubric) const;
+  bool IsSameRubric(const GradingRubric &rubric) const;
+
+  std::string ToString() const;
+};
+
+// The cache keeps one copy of each distinct rubric seen during a session, so a
+// whole roster's worth of sheets ends up pointing at a single rubric instead of
+// carrying around their own copies of every label. It isn't thread-safe; sheets
+// parsed on other threads should be interned once they're back on the main one.
+
+class GradingRubricCache
+{
+  public:
+  GradingRubricCache();
+  ~GradingRubricCache();
+
+  const GradingRubric *Intern(GradingRubric *rubric);
+
+  protected:
+  std::vector<GradingRubric *> m_rubrics;
+
+  private:
+  GradingRubricCache(const GradingRubricCache &);
+  GradingRubricCache &operator=(const GradingRubricCache &);
+};
+
+// Where a sheet stopped making sense. The line and column count from one; a
+// line of zero means the file couldn't be read at all.
+
+struct sParseError
+{
+  int line;
+  int column;
+  std::string message;
+
+  std::string ToString() const;
+};
+
+// What happened when a sheet was moved onto a different rubric. Boxes are
+// named by their category, deduction and criterion labels.
+
+struct sMigration
+{
+  std::vector<std::string> changes;    // How the new rubric differs from the old one.
+  int carried;                         // Applied boxes that made it across.
+  std::vector<std::string> lost;       // Applied boxes with nowhere to go.
+  std::vector<std::string> ambiguous;  // Applied boxes carried across on a guess.
+};
+
+// A sheet is one student's grading: the rubric they're graded with, which of its
+// boxes are applied, and the grader's notes. A sheet parsed from a file owns its
+// rubric until it's interned into a cache; a sheet made from a template just
+// points at it.
+
+class GradingSheet
+{
+  public:
+  GradingSheet();
+  GradingSheet(const GradingRubric *rubric);
+  GradingSheet(const GradingSheet &s);
+  ~GradingSheet();
+
+  GradingSheet &operator=(const GradingSheet &s);
+
+  GradingBoxSet m_applied;  // One per box in the rubric.
+  std::string m_notes;
+  std::string m_pending;    // What the test runner found, until a grader saves the sheet.
+
+  float m_totalPoints;
+
+  const GradingRubric *GetRubric() const;
+  const std::vector<GradingCategory> &GetCategories() const;
+  float GetMaxPoints() const;
+
+  bool Load(std::string filename, sParseError *error = NULL);
+  bool Parse(std::string content, sParseError *error = NULL);
+  bool Parse(const char *content, size_t length, sParseError *error = NULL);
+  void SetRubric(const GradingRubric *rubric);
+  int TakeValues(const GradingRubric &rubric);
+  void Migrate(const GradingRubric *rubric, sMigration *migration);
+  void Intern(GradingRubricCache *cache);
+  void Clear();
+  void Swap(GradingSheet &sheet);
+
+  bool GetDeductionBox(int category, int deduction, int box) const;
+  void SetDeductionBox(int category, int deduction, int box, bool state);
+  float GetDeductionValue(int category, int deduction) const;
+  void UpdateTotal();
+
+  bool HasSameStructure(const GradingSheet &sheet) const;
+
+  std::string PrintGradeFile() const;
+  std::string ToString() const;
+
+  bool SaveGradeFile(std::string filename) const;
+  bool SaveScoreFile(std::string filename) const;
+
+  static std::string ScoreFilename(std::string gradeFilename);
+
+  protected:
+  const GradingRubric *m_rubric;
+  GradingRubric *m_ownRubric;  // Non-NULL if m_rubric is ours to delete.
+};
+
+// Templates can carry lines for the other tools under their boxes, like the
+// test runner's tests and the rule checker's rules, which GradingSheet::Parse
+// skips. Each tool reads them back with ReadTemplateExtras and picks out its
+// own; a line with a word none of them know is an error. Every extra line knows
+// the box it's under: its category, deduction and criterion, counted the way
+// Parse counts them. The deduction is -1 if it isn't under a box, and the
+// criterion is -1 if it's under the deduction itself.
+
+struct sTemplateExtra
+{
+  int line;
+  int column;
+  std::string word;  // The first word, e.g. "TST".
+  std::string text;  // Everything after the word and its space.
+  int category;
+  int deduction;
+  int criterion;
+};
+
+bool ReadTemplateExtras(std::string filename, std::vector<sTemplateExtra> *extras, sParseError *error = NULL);
+const char *FindTemplateBox(const GradingRubric &rubric, const sTemplateExtra &extra, int *box, std::string *label);
+
+// Assignment parts come from parts_conf.txt. Each one says which files in a
+// student's directory are submissions and which one is the grade file, and
+// maybe how to compile the submissions (see GradingCompiler).
+
+struct sAssignmentPart
+{
+  std::string name;
+  std::string submissionFilter;
+  std::string gradeFileFilter;
+  std::string compileCommand;  // Empty if the submissions aren't compiled.
+};
+
+bool LoadAssignmentParts(std::string filename, std::vector<sAssignmentPart> *parts);
+int FindAssignmentPart(const std::vector<sAssignmentPart> &parts, std::string name);
+
+#endif
@@ -0,0 +1,296 @@
+#include "GradingGradebook.h"
+
+#include <stdio.h>
+#include <sstream>
+
+GradingGradebook::GradingGradebook(std::string root, const sAssignmentPart &part):
+  GradingRosterTool(root, part)
+{
+  m_maxPoints = 0.0f;
+  m_graded = 0;
+}
+
+GradingGradebook::~GradingGradebook()
+{
+}
+
+size_t GradingGradebook::GetGradedCount() const
+{
+  return m_graded;
+}
+
+const std::vector<std::string> &GradingGradebook::GetColumns() const
+{
+  return m_columns;
+}
+
+const std::vector<sGradebookRow> &GradingGradebook::GetRows() const
+{
+  return m_rows;
+}
+
+bool GradingGradebook::OnScan()
+{
+  m_rows.clear();
+  m_rows.resize(m_roster.GetCount());
+  for (size_t i = 0; i < m_rows.size(); i++)
+  {
+    m_rows[i].student = m_roster.GetStudent(i);
+    m_rows[i].graded = false;
+    m_rows[i].total = m_rows[i].maxPoints = 0.0f;
+  }
+
+  return true;
+}
+
+void GradingGradebook::OnRunStart(int threads)
+{
+  m_graded = 0;
+  m_labels.clear();
+  m_labels.resize(m_rows.size());
+}
+
+void GradingGradebook::OnRunEnd()
+{
+  BuildColumns();
+}
+
+void GradingGradebook::ProcessStudent(size_t index)
+{
+  sGradebookRow &row = m_rows[index];
+
+  GradingSheet sheet;
+  std::string gradeFilename;
+  if (ReadSheet(index, &sheet, &gradeFilename) != SHEET_READ)
+    return;
+
+  const std::vector<GradingCategory> &categories = sheet.GetCategories();
+
+  // The last category is the special 'no submission' one, which only counts
+  // towards the total. Deductions are numbered from 1 within their category,
+  // and criteria from 1 within their deduction: 2.3 or 2.3.1.
+  std::stringstream ids;
+  for (size_t i = 0; i < categories.size(); i++)
+  {
+    float points = categories[i].m_value;
+
+    for (size_t j = 0; j < categories[i].m_dedux.size(); j++)
+    {
+      const GradingDeduction &ded = categories[i].m_dedux[j];
+      points += sheet.GetDeductionValue(i, j);
+
+      for (size_t k = 0; k < ded.GetBoxCount(); k++)
+      {
+        if (!sheet.GetDeductionBox(i, j, k))
+          continue;
+
+        if (ids.tellp() > 0)
+          ids << ' ';
+        ids << i + 1 << '.' << j + 1;
+        if (ded.m_choices.size() > 0)
+          ids << '.' << k + 1;
+      }
+    }
+
+    if (i + 1 < categories.size())
+    {
+      m_labels[index].push_back(categories[i].m_label);
+      row.points.push_back(points);
+    }
+  }
+
+  row.total = sheet.m_totalPoints;
+  row.maxPoints = sheet.GetMaxPoints();
+  row.deductions = ids.str();
+  row.graded = true;
+
+  wxMutexLocker lock(m_mutex);
+  m_graded++;
+}
+
+// Students graded with different rubrics can have different categories, so the
+// columns are every category label seen, in the order they first turn up. A
+// label used twice in one rubric gets a column for each use.
+void GradingGradebook::BuildColumns()
+{
+  m_columns.clear();
+  m_maxPoints = 0.0f;
+
+  bool first = true;
+  for (size_t i = 0; i < m_rows.size(); i++)
+  {
+    sGradebookRow &row = m_rows[i];
+    if (!row.graded)
+      continue;
+
+    if (first)
+      m_maxPoints = row.maxPoints;
+    first = false;
+
+    std::vector<bool> used(m_columns.size(), false);
+    row.columns.clear();
+    for (size_t j = 0; j < m_labels[i].size(); j++)
+    {
+      size_t column = 0;
+      while (column < m_columns.size() && (used[column] || m_columns[column] != m_labels[i][j]))
+        column++;
+
+      if (column == m_columns.size())
+      {
+        m_columns.push_back(m_labels[i][j]);
+        used.push_back(false);
+      }
+
+      used[column] = true;
+      row.columns.push_back(column);
+    }
+  }
+
+  m_labels.clear();
+}
+
+// Quotes a field if it needs it, doubling any quotes inside.
+static void WriteField(FILE *f, const std::string &field, bool last = false)
+{
+  if (field.find_first_of(",\"\r\n") == std::string::npos)
+    fputs(field.c_str(), f);
+  else
+  {
+    fputc('"', f);
+    for (size_t i = 0; i < field.length(); i++)
+    {
+      if (field[i] == '"')
+        fputc('"', f);
+      fputc(field[i], f);
+    }
+    fputc('"', f);
+  }
+
+  fputc(last?'\n':',', f);
+}
+
+bool GradingGradebook::Write(std::string filename, Layout layout) const
+{
+  FILE *f = fopen(filename.c_str(), "w");
+  if (f == NULL)
+    return false;
+
+  std::string max = formatFloat(m_maxPoints);
+
+  if (layout == LAYOUT_CANVAS)
+  {
+    fputs("Student,ID,SIS Login ID,Section,", f);
+    WriteField(f, m_part.name, true);
+    fprintf(f, "Points Possible,,,,%s\n", max.c_str());
+  }
+  else if (layout == LAYOUT_BLACKBOARD)
+  {
+    fputs("Username,", f);
+    WriteField(f, m_part.name + " [Total Pts: " + max + " Score]", true);
+  }
+  else
+  {
+    fputs("Student,", f);
+    for (size_t i = 0; i < m_columns.size(); i++)
+      WriteField(f, m_columns[i]);
+    fputs("Total,Max,Deductions\n", f);
+  }
+
+  std::vector<std::string> cells;
+  for (size_t i = 0; i < m_rows.size(); i++)
+  {
+    const sGradebookRow &row = m_rows[i];
+    std::string total = row.graded?formatFloat(row.total):"";
+
+    if (layout == LAYOUT_CANVAS)
+    {
+      WriteField(f, row.student);
+      fputs(",", f);
+      WriteField(f, row.student);
+      fputs(",", f);
+      WriteField(f, total, true);
+    }
+    else if (layout == LAYOUT_BLACKBOARD)
+    {
+      WriteField(f, row.student);
+      WriteField(f, total, true);
+    }
+    else
+    {
+      cells.assign(m_columns.size(), "");
+      for (size_t j = 0; j < row.columns.size(); j++)
+        cells[row.columns[j]] = formatFloat(row.points[j]);
+
+      WriteField(f, row.student);
+      for (size_t j = 0; j < cells.size(); j++)
+        WriteField(f, cells[j]);
+      WriteField(f, total);
+      WriteField(f, row.graded?formatFloat(row.maxPoints):"");
+      WriteField(f, row.deductions, true);
+    }
+  }
+
+  bool ok = !ferror(f);
+  if (fclose(f) != 0)
+    ok = false;
+
+  return ok;
+}
+
+bool GradingGradebook::GetLayout(std::string name, Layout *layout)
+{
+  if (name == "csv")
+    *layout = LAYOUT_CSV;
+  else if (name == "canvas")
+    *layout = LAYOUT_CANVAS;
+  else if (name == "blackboard")
+    *layout = LAYOUT_BLACKBOARD;
+  else
+    return false;
+
+  return true;
+}
+
+int GradingGradebook::Main(int argc, char **argv)
+{
+  if ((argc != 5 && argc != 6) || std::string(argv[1]) != "--gradebook")
+  {
+    fprintf(stderr, "usage: %s --gradebook <part> <roster root> <output> [csv|canvas|blackboard]\n", argv[0]);
+    return 2;
+  }
+
+  Layout layout = LAYOUT_CSV;
+  if (argc == 6 && !GetLayout(argv[5], &layout))
+  {
+    fprintf(stderr, "I don't know how to write a \"%s\" gradebook.\n", argv[5]);
+    return 2;
+  }
+
+  sAssignmentPart part;
+  if (!LoadPart(argv[2], &part))
+    return 1;
+
+  GradingGradebook gradebook(argv[3], part);
+  if (!gradebook.Scan())
+  {
+    fprintf(stderr, "I couldn't open the roster directory %s.\n", argv[3]);
+    return 1;
+  }
+
+  gradebook.Run();
+  gradebook.PrintErrors();
+
+  const std::vector<std::string> &errors = gradebook.GetErrors();
+  if (!gradebook.Write(argv[4], layout))
+  {
+    fprintf(stderr, "I couldn't write the gradebook to %s.\n", argv[4]);
+    return 1;
+  }
+
+  printf("Wrote %u students to %s (%u without a score sheet, %u awaiting confirmation, %u errors).\n",
+    (unsigned int)gradebook.GetStudentCount(), argv[4],
+    (unsigned int)(gradebook.GetStudentCount() - gradebook.GetGradedCount() - gradebook.GetUnconfirmedCount() - errors.size()),
+    (unsigned int)gradebook.GetUnconfirmedCount(), (unsigned int)errors.size());
+
+  return errors.size() > 0;
+}
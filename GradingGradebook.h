@@ -0,0 +1,72 @@
+#ifndef GRADINGGRADEBOOK_H
+#define GRADINGGRADEBOOK_H
+
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+#include "GradingRosterTool.h"
+
+// The gradebook reads every student's .ss sheet under the roster root, the same
+// way batch mode finds them, and collects what they add up to into one table.
+// Sheets are parsed on a pool of worker threads (see GradingRosterTool); the
+// table comes out in roster order no matter which thread got to which student
+// first.
+
+struct sGradebookRow
+{
+  std::string student;
+  bool graded;  // False if they don't have a score sheet yet, or only the tests have marked it.
+
+  std::vector<int> columns;   // Which gradebook column each of their categories goes in.
+  std::vector<float> points;  // What they got in each of those categories.
+  float total;
+  float maxPoints;
+  std::string deductions;     // IDs of the applied boxes, separated by spaces.
+};
+
+class GradingGradebook: public GradingRosterTool
+{
+  public:
+  // What the written file looks like.
+  //   LAYOUT_CSV        - Everything: a column per category, total, max and deductions.
+  //   LAYOUT_CANVAS     - Canvas's gradebook import, matched on SIS Login ID.
+  //   LAYOUT_BLACKBOARD - Blackboard's Grade Center upload, matched on Username.
+  // The LMS layouts only carry the total, and use the directory names as logins.
+  enum Layout {
+    LAYOUT_CSV,
+    LAYOUT_CANVAS,
+    LAYOUT_BLACKBOARD
+  };
+
+  GradingGradebook(std::string root, const sAssignmentPart &part);
+  ~GradingGradebook();
+
+  bool Write(std::string filename, Layout layout) const;
+
+  size_t GetGradedCount() const;
+  const std::vector<std::string> &GetColumns() const;
+  const std::vector<sGradebookRow> &GetRows() const;
+
+  static bool GetLayout(std::string name, Layout *layout);
+
+  // Command line entry point: grader --gradebook <part> <roster root> <output> [layout]
+  static int Main(int argc, char **argv);
+
+  protected:
+  std::vector<sGradebookRow> m_rows;
+  std::vector<std::string> m_columns;
+  float m_maxPoints;
+  size_t m_graded;
+
+  // Category labels per row, until Run sorts them into columns.
+  std::vector<std::vector<std::string> > m_labels;
+
+  bool OnScan();
+  void OnRunStart(int threads);
+  void OnRunEnd();
+  void ProcessStudent(size_t index);
+  void BuildColumns();
+};
+
+#endif
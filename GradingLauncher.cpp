@@ -0,0 +1,304 @@
+// Job objects with memory limits need Windows 2000.
+#if defined(_WIN32) && !defined(_WIN32_WINNT)
+#define _WIN32_WINNT 0x0500
+#endif
+
+#include "GradingLauncher.h"
+
+#include <wx/stopwatch.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
+// Anything that prints more than this is stuck in a loop, as far as we care.
+const size_t GradingLauncher::MAX_OUTPUT = 1 << 20;
+
+//-----GradingLauncher-----
+
+// Runs a command in a directory (or the grader's own, if it's empty) with the
+// given limits (0 for none), and waits for it. Returns false if it couldn't be
+// started at all.
+bool GradingLauncher::Run(std::string command, std::string directory, std::string inputFilename, int seconds, int megabytes,
+  sProcessResult *result)
+{
+  result->timedOut = false;
+  result->truncated = false;
+  result->status = -1;
+  result->output.clear();
+
+  char buffer[4096];
+  wxStopWatch watch;
+  long timeLimit = (seconds > 0)?seconds * 1000L:-1;
+
+#ifdef _WIN32
+  // The job takes the whole process tree down if it runs out of time, and
+  // holds it to the memory limit.
+  HANDLE job = CreateJobObject(NULL, NULL);
+  if (job == NULL)
+    return false;
+
+  JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+  ZeroMemory(&limits, sizeof(limits));
+  limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+  if (megabytes > 0)
+  {
+    limits.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+    limits.ProcessMemoryLimit = (SIZE_T)megabytes << 20;
+  }
+  SetInformationJobObject(job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+
+  HANDLE readOutput, writeOutput;
+  if (!CreatePipe(&readOutput, &writeOutput, NULL, 0))
+  {
+    CloseHandle(job);
+    return false;
+  }
+
+  HANDLE input = CreateFile(inputFilename.empty()?"NUL":inputFilename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, 0, NULL);
+  if (input == INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(readOutput);
+    CloseHandle(writeOutput);
+    CloseHandle(job);
+    return false;
+  }
+
+  STARTUPINFO startup;
+  ZeroMemory(&startup, sizeof(startup));
+  startup.cb = sizeof(startup);
+  startup.dwFlags = STARTF_USESTDHANDLES;
+  startup.hStdInput = input;
+  startup.hStdOutput = writeOutput;
+  startup.hStdError = writeOutput;
+
+  std::string line = "cmd /s /c \"" + command + "\"";
+  std::vector<char> commandLine(line.begin(), line.end());
+  commandLine.push_back('\0');
+
+  PROCESS_INFORMATION process;
+  BOOL started;
+  {
+    // Only this process gets to inherit the handles.
+    wxMutexLocker lock(m_spawnMutex);
+    SetHandleInformation(input, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+    SetHandleInformation(writeOutput, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+    started = CreateProcess(NULL, &commandLine[0], NULL, NULL, TRUE, CREATE_SUSPENDED | CREATE_NO_WINDOW, NULL,
+      directory.empty()?NULL:directory.c_str(), &startup, &process);
+    SetHandleInformation(input, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(writeOutput, HANDLE_FLAG_INHERIT, 0);
+  }
+
+  CloseHandle(input);
+  CloseHandle(writeOutput);
+  if (!started)
+  {
+    CloseHandle(readOutput);
+    CloseHandle(job);
+    return false;
+  }
+
+  AssignProcessToJobObject(job, process.hProcess);
+  ResumeThread(process.hThread);
+  CloseHandle(process.hThread);
+
+  // Pipes can't be waited on with a timeout, so they're peeked at instead. The
+  // pipe breaks once nothing has it open for writing any more.
+  bool exited = false;
+  while (true)
+  {
+    DWORD available = 0, read = 0;
+    if (!PeekNamedPipe(readOutput, NULL, 0, NULL, &available, NULL))
+      break;
+
+    if (available > 0)
+    {
+      if (!ReadFile(readOutput, buffer, std::min((DWORD)sizeof(buffer), available), &read, NULL))
+        break;
+      result->output.append(buffer, read);
+      if (result->output.length() > MAX_OUTPUT)
+      {
+        result->truncated = true;
+        break;
+      }
+      continue;
+    }
+
+    // Once it's exited, everything it printed has been read.
+    if (exited)
+      break;
+    exited = (WaitForSingleObject(process.hProcess, 10) == WAIT_OBJECT_0);
+
+    if (!exited && timeLimit >= 0 && watch.Time() >= timeLimit)
+    {
+      result->timedOut = true;
+      break;
+    }
+  }
+
+  if (result->timedOut || result->truncated)
+    TerminateJobObject(job, 1);
+  else
+  {
+    // Whatever's left of the time is what it gets to finish up in.
+    long left = (timeLimit >= 0)?std::max(timeLimit - watch.Time(), 0L):-1;
+    if (WaitForSingleObject(process.hProcess, (left >= 0)?(DWORD)left:INFINITE) != WAIT_OBJECT_0)
+    {
+      result->timedOut = true;
+      TerminateJobObject(job, 1);
+    }
+  }
+
+  WaitForSingleObject(process.hProcess, INFINITE);
+  DWORD status;
+  if (GetExitCodeProcess(process.hProcess, &status))
+    result->status = status;
+
+  CloseHandle(process.hProcess);
+  CloseHandle(readOutput);
+  CloseHandle(job);
+#else
+  std::string shell = "/bin/sh";
+  std::string inputPath = inputFilename.empty()?"/dev/null":inputFilename;
+  rlim_t memoryLimit = (rlim_t)megabytes << 20;
+
+  int output[2];
+  int input;
+  pid_t pid;
+  {
+    // Everything's close-on-exec, so only this process ends up with them.
+    wxMutexLocker lock(m_spawnMutex);
+
+    if (pipe(output) != 0)
+      return false;
+    fcntl(output[0], F_SETFD, FD_CLOEXEC);
+    fcntl(output[1], F_SETFD, FD_CLOEXEC);
+
+    input = open(inputPath.c_str(), O_RDONLY);
+    if (input < 0)
+    {
+      close(output[0]);
+      close(output[1]);
+      return false;
+    }
+    fcntl(input, F_SETFD, FD_CLOEXEC);
+
+    pid = fork();
+    if (pid == 0)
+    {
+      // Its own process group, so the whole thing can be killed at once.
+      setpgid(0, 0);
+      struct rlimit limit;
+      if (megabytes > 0)
+      {
+        limit.rlim_cur = limit.rlim_max = memoryLimit;
+        setrlimit(RLIMIT_AS, &limit);
+      }
+
+      // Nobody wants a core file from every crashing test.
+      limit.rlim_cur = limit.rlim_max = 0;
+      setrlimit(RLIMIT_CORE, &limit);
+
+      if (!directory.empty() && chdir(directory.c_str()) != 0)
+        _exit(127);
+
+      dup2(input, 0);
+      dup2(output[1], 1);
+      dup2(output[1], 2);
+      execl(shell.c_str(), "sh", "-c", command.c_str(), (char *)NULL);
+      _exit(127);
+    }
+
+    close(input);
+    close(output[1]);
+  }
+
+  if (pid < 0)
+  {
+    close(output[0]);
+    return false;
+  }
+  setpgid(pid, pid);
+
+  struct pollfd ready;
+  ready.fd = output[0];
+  ready.events = POLLIN;
+  while (true)
+  {
+    long left = (timeLimit >= 0)?timeLimit - watch.Time():-1;
+    if (timeLimit >= 0 && left <= 0)
+    {
+      result->timedOut = true;
+      break;
+    }
+
+    int count = poll(&ready, 1, (int)left);
+    if (count < 0 && errno != EINTR)
+      break;
+    if (count <= 0)
+      continue;
+
+    ssize_t read = ::read(output[0], buffer, sizeof(buffer));
+    if (read < 0 && errno == EINTR)
+      continue;
+    if (read <= 0)
+      break;
+
+    result->output.append(buffer, read);
+    if (result->output.length() > MAX_OUTPUT)
+    {
+      result->truncated = true;
+      break;
+    }
+  }
+  close(output[0]);
+
+  // It can close its output and carry on, so it might still need waiting for.
+  int status = 0;
+  pid_t waited = 0;
+  while (!result->timedOut && !result->truncated)
+  {
+    waited = waitpid(pid, &status, WNOHANG);
+    if (waited != 0 && !(waited < 0 && errno == EINTR))
+      break;
+    if (timeLimit >= 0 && watch.Time() >= timeLimit)
+      result->timedOut = true;
+    else
+      usleep(10000);
+  }
+
+  if (result->timedOut || result->truncated)
+  {
+    kill(-pid, SIGKILL);
+    while ((waited = waitpid(pid, &status, 0)) < 0 && errno == EINTR)
+      ;
+  }
+  else
+    kill(-pid, SIGKILL);  // Whatever it left running in the background.
+
+  if (waited == pid)
+  {
+    if (WIFEXITED(status))
+      result->status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+      result->status = 128 + WTERMSIG(status);
+  }
+#endif
+
+  result->milliseconds = watch.Time();
+
+  // Line endings are put back when it's written out, if they need to be.
+  result->output.erase(std::remove(result->output.begin(), result->output.end(), '\r'), result->output.end());
+  return true;
+}
@@ -0,0 +1,42 @@
+#ifndef GRADINGLAUNCHER_H
+#define GRADINGLAUNCHER_H
+
+#include <wx/thread.h>
+#include <string>
+
+// What happened when a command was run.
+
+struct sProcessResult
+{
+  bool timedOut;
+  bool truncated;     // It printed too much and was stopped.
+  int status;
+  std::string output; // Everything it printed, errors and all.
+  long milliseconds;  // From starting it to it finishing (or being stopped).
+};
+
+// The launcher runs commands through the shell with their output captured,
+// their input from a file, and limits on their time, memory and output: a job
+// object on Windows, and resource limits on POSIX. Each one runs in the
+// directory it's given, usually a scratch directory of its own, so whatever it
+// writes to relative paths can't land in the grader's directory or be seen by
+// the next one. Each one gets its own process group (or job), and anything
+// still left in it when it's done is killed, so nothing a test started
+// outlives it. How long each one took comes back with what it printed.
+//
+// It's safe to call Run from several threads at once, but the processes are
+// started one at a time, so they don't inherit each other's pipes.
+
+class GradingLauncher
+{
+  public:
+  bool Run(std::string command, std::string directory, std::string inputFilename, int seconds, int megabytes,
+    sProcessResult *result);
+
+  static const size_t MAX_OUTPUT;
+
+  protected:
+  wxMutex m_spawnMutex;  // Held while a process is being started.
+};
+
+#endif
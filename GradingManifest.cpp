@@ -0,0 +1,550 @@
+#include "GradingManifest.h"
+#include "GradingCore.h"
+
+#include <wx/dir.h>
+#include <wx/filefn.h>
+#include <wx/stdpaths.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <fstream>
+
+// Directories that were changed less than this many seconds before they were
+// listed might have changed again in the same second (or two, on FAT), so
+// they're listed again next time instead of being trusted.
+static const time_t SETTLE_TIME = 2;
+
+static time_t Settled(time_t modified, time_t listed)
+{
+  return (modified + SETTLE_TIME >= listed)?0:modified;
+}
+
+// Splits a line at its first count - 1 tabs; whatever's left over, tabs and
+// all, is the last field.
+static bool SplitFields(const std::string &line, size_t count, std::vector<std::string> *fields)
+{
+  fields->clear();
+
+  size_t start = 0;
+  while (fields->size() + 1 < count)
+  {
+    size_t tab = line.find('\t', start);
+    if (tab == std::string::npos)
+      return false;
+
+    fields->push_back(line.substr(start, tab - start));
+    start = tab + 1;
+  }
+
+  fields->push_back(line.substr(start));
+  return true;
+}
+
+//-----GradingFileClassifier-----
+
+GradingFileClassifier::GradingFileClassifier()
+{
+  Clear();
+}
+
+void GradingFileClassifier::Clear()
+{
+  m_filters.clear();
+  m_suffixes.clear();
+  m_names.clear();
+  m_others.clear();
+
+  // Every part looks for score sheets.
+  Add("*.ss");
+}
+
+void GradingFileClassifier::AddParts(const std::vector<sAssignmentPart> &parts)
+{
+  for (size_t i = 0; i < parts.size(); i++)
+  {
+    Add(parts[i].submissionFilter);
+    Add(parts[i].gradeFileFilter);
+  }
+}
+
+// Returns the filter's bit. Filters that are already there (parts often share
+// them) keep the bit they had.
+size_t GradingFileClassifier::Add(std::string filter)
+{
+  int found = Find(filter);
+  if (found >= 0)
+    return found;
+
+  filter = Normalize(filter);
+  size_t bit = m_filters.size();
+  m_filters.push_back(filter);
+
+  size_t wild = filter.find_first_of("*?");
+  if (wild == std::string::npos)
+    m_names[filter].push_back(bit);
+  else if (wild == 0 && filter.length() > 1 && filter[1] == '.' && filter.find_first_of("*?", 1) == std::string::npos)
+    m_suffixes[filter.substr(1)].push_back(bit);
+  else
+    m_others.push_back(bit);
+
+  return bit;
+}
+
+// Returns -1 if the filter was never added.
+int GradingFileClassifier::Find(std::string filter) const
+{
+  filter = Normalize(filter);
+  for (size_t i = 0; i < m_filters.size(); i++)
+    if (m_filters[i] == filter)
+      return i;
+
+  return -1;
+}
+
+size_t GradingFileClassifier::GetCount() const
+{
+  return m_filters.size();
+}
+
+void GradingFileClassifier::Classify(std::string filename, GradingBoxSet *matches) const
+{
+  matches->Assign(m_filters.size());
+
+  std::string name = FoldCase(filename);
+  std::map<std::string, std::vector<size_t> >::const_iterator it = m_names.find(name);
+  if (it != m_names.end())
+    for (size_t i = 0; i < it->second.size(); i++)
+      matches->Set(it->second[i], true);
+
+  // "*" can match nothing at all, so "*.java" matches ".java" too.
+  for (size_t dot = name.find('.'); dot != std::string::npos; dot = name.find('.', dot + 1))
+  {
+    it = m_suffixes.find(name.substr(dot));
+    if (it != m_suffixes.end())
+      for (size_t i = 0; i < it->second.size(); i++)
+        matches->Set(it->second[i], true);
+  }
+
+  for (size_t i = 0; i < m_others.size(); i++)
+    if (wxMatchWild(m_filters[m_others[i]].c_str(), name.c_str(), false))
+      matches->Set(m_others[i], true);
+}
+
+bool GradingFileClassifier::Matches(std::string filter, std::string filename)
+{
+  return wxMatchWild(Normalize(filter).c_str(), FoldCase(filename).c_str(), false);
+}
+
+// Windows doesn't care about case in file names, so neither does wxDir there.
+std::string GradingFileClassifier::FoldCase(std::string name)
+{
+#ifdef __WXMSW__
+  for (size_t i = 0; i < name.length(); i++)
+    name[i] = tolower((unsigned char)name[i]);
+#endif
+  return name;
+}
+
+// Windows also takes "*.*" to mean every file, dot or no dot.
+std::string GradingFileClassifier::Normalize(std::string filter)
+{
+  filter = FoldCase(filter);
+#ifdef __WXMSW__
+  if (filter == "*.*")
+    filter = "*";
+#endif
+  return filter;
+}
+
+//-----GradingManifest-----
+
+GradingManifest::GradingManifest()
+{
+  m_rootModified = 0;
+  m_changed = false;
+}
+
+// Picks up the saved manifest for the root, if there is one, and lists the
+// root again if it's changed since. Returns false if the root can't be read.
+bool GradingManifest::Open(std::string root)
+{
+  wxMutexLocker lock(m_mutex);
+
+  m_root = root;
+  m_rootModified = 0;
+  m_students.clear();
+  m_index.clear();
+  m_changed = false;
+
+  time_t modified = GetModificationTime(root);
+  if (modified == 0)
+    return false;
+
+  // A missing or broken manifest just means starting from scratch.
+  if (!Load(GetFilename(root)))
+  {
+    m_rootModified = 0;
+    m_students.clear();
+  }
+  BuildIndex();
+  ClassifyAll();
+
+  if (modified != m_rootModified)
+  {
+    wxDir dir(root);
+    if (!dir.IsOpened())
+      return false;
+
+    time_t listed = time(NULL);
+    std::vector<sManifestStudent> students;
+
+    wxString filename;
+    bool more = dir.GetFirst(&filename, "", wxDIR_DIRS);
+    while (more)
+    {
+      // Students who were already there keep what was known about them.
+      std::map<std::string, size_t>::const_iterator it = m_index.find(filename.c_str());
+      if (it != m_index.end())
+        students.push_back(m_students[it->second]);
+      else
+      {
+        sManifestStudent student;
+        student.name = filename.c_str();
+        student.modified = 0;
+        student.graded = false;
+        students.push_back(student);
+      }
+      more = dir.GetNext(&filename);
+    }
+
+    m_students.swap(students);
+    m_rootModified = Settled(modified, listed);
+    m_changed = true;
+    BuildIndex();
+  }
+
+  return true;
+}
+
+// The manifest is only a cache, so there's nothing to be done if it can't be
+// saved; the next session will just have to list everything again.
+bool GradingManifest::Save()
+{
+  std::string content;
+  {
+    wxMutexLocker lock(m_mutex);
+
+    if (m_root.empty())
+      return false;
+
+    content = "grader manifest 1\n" + m_root + "\n";
+    content += wxString::Format("%lu\n", (unsigned long)m_rootModified).c_str();
+
+    for (size_t i = 0; i < m_students.size(); i++)
+    {
+      const sManifestStudent &student = m_students[i];
+      content += wxString::Format("S\t%lu\t%d\t", (unsigned long)student.modified, student.graded?1:0).c_str();
+      content += student.name + "\n";
+
+      for (size_t j = 0; j < student.files.size(); j++)
+      {
+        const sManifestFile &file = student.files[j];
+        content += wxString::Format("F\t%lu\t%lu\t%08x\t", file.size, (unsigned long)file.modified, file.hash).c_str();
+        content += file.name + "\n";
+      }
+    }
+
+    m_changed = false;
+  }
+
+  std::string filename = GetFilename(m_root);
+  std::string directory = filename.substr(0, filename.find_last_of("/\\"));
+  if (!wxDirExists(directory))
+    wxMkdir(directory);
+
+  if (!WriteFileAtomically(filename, content))
+  {
+    wxMutexLocker lock(m_mutex);
+    m_changed = true;
+    return false;
+  }
+
+  return true;
+}
+
+bool GradingManifest::IsModified() const
+{
+  wxMutexLocker lock(m_mutex);
+  return m_changed;
+}
+
+std::string GradingManifest::GetRoot() const
+{
+  return m_root;
+}
+
+size_t GradingManifest::GetCount() const
+{
+  return m_students.size();
+}
+
+const std::string &GradingManifest::GetStudent(size_t index) const
+{
+  return m_students[index].name;
+}
+
+// Compiles every part's filters into the classifier and sorts the files that
+// are already known. It has to be called before any other thread uses the
+// manifest, since listings are classified without the lock.
+void GradingManifest::SetParts(const std::vector<sAssignmentPart> &parts)
+{
+  wxMutexLocker lock(m_mutex);
+
+  m_classifier.Clear();
+  m_classifier.AddParts(parts);
+  ClassifyAll();
+}
+
+// Fills in what's in a student's directory, listing it again first if it's
+// changed. It's safe to call from any thread once the manifest is open.
+// Returns false if the directory isn't one of the roster's, or can't be read.
+bool GradingManifest::GetFiles(std::string directory, sManifestStudent *student)
+{
+  std::string name = directory.substr(directory.find_last_of("/\\") + 1);
+  size_t index;
+  sManifestStudent known;
+  {
+    wxMutexLocker lock(m_mutex);
+
+    std::map<std::string, size_t>::const_iterator it = m_index.find(name);
+    if (it == m_index.end())
+      return false;
+
+    index = it->second;
+    known = m_students[index];
+  }
+
+  time_t modified = GetModificationTime(directory);
+  if (modified == 0)
+    return false;
+
+  if (modified == known.modified)
+  {
+    *student = known;
+    return true;
+  }
+
+  // The listing happens without the lock, so other students can be looked
+  // up meanwhile; it's usually the slow part.
+  time_t listed = time(NULL);
+  if (!ListStudent(directory, known, m_classifier, student))
+    return false;
+  student->modified = Settled(modified, listed);
+
+  wxMutexLocker lock(m_mutex);
+  m_students[index] = *student;
+  m_changed = true;
+  return true;
+}
+
+// Whether a file matches a filter, going by its bits if the filter is one the
+// classifier knows.
+static bool IsMatch(const sManifestFile &file, int bit, const std::string &filter)
+{
+  if (bit >= 0 && (size_t)bit < file.matches.GetSize())
+    return file.matches.Get(bit);
+
+  return GradingFileClassifier::Matches(filter, file.name);
+}
+
+// Picks out a part's files from a student's directory, in the order wxDir
+// would have found them, which is the directory's own order.
+bool GradingManifest::GetPartFiles(std::string directory, const sAssignmentPart &part, sPartFiles *files)
+{
+  sManifestStudent student;
+  if (!GetFiles(directory, &student))
+    return false;
+
+  files->submissions.clear();
+  files->gradeFilename.clear();
+  files->scoreFilename.clear();
+
+  int submission = m_classifier.Find(part.submissionFilter);
+  int grade = m_classifier.Find(part.gradeFileFilter);
+  int score = m_classifier.Find("*.ss");
+
+  for (size_t i = 0; i < student.files.size(); i++)
+  {
+    const sManifestFile &file = student.files[i];
+    if (IsMatch(file, submission, part.submissionFilter))
+      files->submissions.push_back(file.name);
+    if (files->gradeFilename.empty() && IsMatch(file, grade, part.gradeFileFilter))
+      files->gradeFilename = file.name;
+    if (files->scoreFilename.empty() && IsMatch(file, score, "*.ss"))
+      files->scoreFilename = file.name;
+  }
+
+  return true;
+}
+
+// A file's hash as of when it was listed, so it doesn't have to be read again
+// just to be hashed. A file that's edited in place isn't listed again, so its
+// size and modification time have to still match too. Returns false if it
+// isn't in the manifest, couldn't be read then, or might have changed since.
+bool GradingManifest::GetFileHash(std::string directory, std::string name, unsigned int *hash, unsigned long *size)
+{
+  sManifestStudent student;
+  if (!GetFiles(directory, &student))
+    return false;
+
+  for (size_t i = 0; i < student.files.size(); i++)
+  {
+    const sManifestFile &file = student.files[i];
+    if (file.name != name)
+      continue;
+
+    wxStructStat st;
+    if (file.hash == 0 || file.modified == 0 || wxStat((directory + '/' + name).c_str(), &st) != 0 ||
+      (unsigned long)st.st_size != file.size || st.st_mtime != file.modified)
+      return false;
+
+    *hash = file.hash;
+    *size = file.size;
+    return true;
+  }
+
+  return false;
+}
+
+// Manifests are named after a hash of their root, so each roster gets its own.
+std::string GradingManifest::GetFilename(std::string root)
+{
+  std::string directory = wxStandardPaths::Get().GetUserDataDir().c_str();
+  return directory + wxString::Format("/manifest-%08x.txt", HashContent(root.c_str(), root.length())).c_str();
+}
+
+bool GradingManifest::Load(std::string filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::in);
+  std::string line;
+
+  if (!getline(in, line) || line != "grader manifest 1")
+    return false;
+
+  // Two roots could hash the same; the manifest only counts if it's this one's.
+  if (!getline(in, line) || line != m_root)
+    return false;
+
+  if (!getline(in, line))
+    return false;
+  m_rootModified = strtoul(line.c_str(), NULL, 10);
+
+  std::vector<std::string> fields;
+  while (getline(in, line))
+  {
+    if (line.length() > 0 && line[line.length() - 1] == '\r')
+      line.resize(line.length() - 1);
+
+    if (line.compare(0, 2, "S\t") == 0 && SplitFields(line, 4, &fields))
+    {
+      sManifestStudent student;
+      student.modified = strtoul(fields[1].c_str(), NULL, 10);
+      student.graded = fields[2] == "1";
+      student.name = fields[3];
+      m_students.push_back(student);
+    }
+    else if (line.compare(0, 2, "F\t") == 0 && SplitFields(line, 5, &fields) && m_students.size() > 0)
+    {
+      sManifestFile file;
+      file.size = strtoul(fields[1].c_str(), NULL, 10);
+      file.modified = strtoul(fields[2].c_str(), NULL, 10);
+      file.hash = strtoul(fields[3].c_str(), NULL, 16);
+      file.name = fields[4];
+      m_students.back().files.push_back(file);
+    }
+    else
+      return false;
+  }
+
+  return true;
+}
+
+void GradingManifest::ClassifyAll()
+{
+  for (size_t i = 0; i < m_students.size(); i++)
+    for (size_t j = 0; j < m_students[i].files.size(); j++)
+      m_classifier.Classify(m_students[i].files[j].name, &m_students[i].files[j].matches);
+}
+
+void GradingManifest::BuildIndex()
+{
+  m_index.clear();
+  for (size_t i = 0; i < m_students.size(); i++)
+    m_index[m_students[i].name] = i;
+}
+
+// Returns 0 if there's no such file or directory.
+time_t GradingManifest::GetModificationTime(std::string path)
+{
+  wxStructStat st;
+  if (wxStat(path.c_str(), &st) != 0)
+    return 0;
+
+  return st.st_mtime;
+}
+
+// Lists a student's directory. Files that are the same size and age as they
+// were last time keep their old hash; anything else gets read and hashed.
+bool GradingManifest::ListStudent(std::string directory, const sManifestStudent &known, const GradingFileClassifier &classifier,
+  sManifestStudent *student)
+{
+  int score = classifier.Find("*.ss");
+
+  wxDir dir(directory);
+  if (!dir.IsOpened())
+    return false;
+
+  student->name = known.name;
+  student->graded = false;
+  student->files.clear();
+
+  wxString filename;
+  bool more = dir.GetFirst(&filename, "", wxDIR_FILES);
+  while (more)
+  {
+    sManifestFile file;
+    file.name = filename.c_str();
+    file.size = 0;
+    file.modified = 0;
+
+    std::string path = directory + '/' + file.name;
+    wxStructStat st;
+    if (wxStat(path.c_str(), &st) == 0)
+    {
+      file.size = st.st_size;
+      file.modified = st.st_mtime;
+    }
+
+    const sManifestFile *old = NULL;
+    for (size_t i = 0; i < known.files.size() && old == NULL; i++)
+      if (known.files[i].name == file.name)
+        old = &known.files[i];
+
+    if (old != NULL && file.modified != 0 && old->size == file.size && old->modified == file.modified)
+      file.hash = old->hash;
+    else
+    {
+      GradingFileView view;
+      file.hash = view.Open(path)?HashContent(view.GetData(), view.GetLength()):0;
+    }
+
+    classifier.Classify(file.name, &file.matches);
+    if (file.matches.Get(score))
+      student->graded = true;
+
+    student->files.push_back(file);
+    more = dir.GetNext(&filename);
+  }
+
+  return true;
+}
@@ -0,0 +1,124 @@
+#ifndef GRADINGMANIFEST_H
+#define GRADINGMANIFEST_H
+
+#include <wx/thread.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+
+// The classifier matches a file name against every filter from parts_conf.txt
+// at once, instead of listing the directory once per filter. Filters like
+// "*.java", which is most of them, are looked up by the name's suffixes, plain
+// names are looked up whole, and only whatever's left over is matched one at a
+// time. Filters are matched the way wxDir would match them on this platform.
+
+class GradingFileClassifier
+{
+  public:
+  GradingFileClassifier();
+
+  void Clear();
+  void AddParts(const std::vector<sAssignmentPart> &parts);
+  size_t Add(std::string filter);
+  int Find(std::string filter) const;
+  size_t GetCount() const;
+
+  void Classify(std::string filename, GradingBoxSet *matches) const;
+
+  static bool Matches(std::string filter, std::string filename);
+
+  protected:
+  std::vector<std::string> m_filters;
+  std::map<std::string, std::vector<size_t> > m_suffixes;  // "*.java" is under ".java".
+  std::map<std::string, std::vector<size_t> > m_names;
+  std::vector<size_t> m_others;
+
+  static std::string FoldCase(std::string name);
+  static std::string Normalize(std::string filter);
+};
+
+// The manifest remembers what was in each student's directory the last time
+// anybody looked: every file's name, size, modification time and a hash of its
+// contents (which the compiler and the outline cache use instead of reading
+// the file again), and whether there's a score sheet. It's kept between sessions, one
+// per roster root, in the user's data directory (not under the root, so saving
+// it doesn't count as a change to the roster).
+//
+// Nothing is listed again unless its directory's modification time has moved.
+// That happens whenever a file in it is created, deleted or renamed, and saving
+// a sheet renames it into place, so grading counts too. Opening a roster then
+// only has to look at the root itself, and each student's directory is only
+// looked at when they're asked for. A file that's edited in place, without
+// touching its directory, isn't noticed. Every file's name is run through the
+// classifier once, when it's listed (or loaded), and each part's files are
+// then just picked out of the bits.
+
+struct sManifestFile
+{
+  std::string name;
+  unsigned long size;
+  time_t modified;
+  unsigned int hash;  // Of the contents; 0 if it couldn't be read.
+  GradingBoxSet matches;  // Which of the classifier's filters the name matches.
+};
+
+struct sManifestStudent
+{
+  std::string name;
+  time_t modified;  // Of the directory when it was listed; 0 if it has to be listed again.
+  bool graded;      // Whether there's a .ss score sheet.
+  std::vector<sManifestFile> files;  // In the order the directory listed them.
+};
+
+// What one assignment part wants out of a student's directory.
+
+struct sPartFiles
+{
+  std::vector<std::string> submissions;
+  std::string gradeFilename;  // The first match, or empty.
+  std::string scoreFilename;  // The first .ss file, or empty.
+};
+
+class GradingManifest
+{
+  public:
+  GradingManifest();
+
+  bool Open(std::string root);
+  bool Save();
+  bool IsModified() const;
+
+  std::string GetRoot() const;
+  size_t GetCount() const;
+  const std::string &GetStudent(size_t index) const;
+
+  void SetParts(const std::vector<sAssignmentPart> &parts);
+  bool GetFiles(std::string directory, sManifestStudent *student);
+  bool GetPartFiles(std::string directory, const sAssignmentPart &part, sPartFiles *files);
+  bool GetFileHash(std::string directory, std::string name, unsigned int *hash, unsigned long *size);
+
+  static std::string GetFilename(std::string root);
+
+  protected:
+  std::string m_root;
+  time_t m_rootModified;
+  std::vector<sManifestStudent> m_students;
+  std::map<std::string, size_t> m_index;
+  bool m_changed;  // Since it was last loaded or saved.
+  GradingFileClassifier m_classifier;
+  mutable wxMutex m_mutex;
+
+  bool Load(std::string filename);
+  void ListRoot();
+  void BuildIndex();
+
+  static time_t GetModificationTime(std::string path);
+  void ClassifyAll();
+  static bool ListStudent(std::string directory, const sManifestStudent &old, const GradingFileClassifier &classifier,
+    sManifestStudent *student);
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include "GradingMigrate.h"
+
+#include <stdio.h>
+
+GradingMigrate::GradingMigrate(std::string root, const sAssignmentPart &part, const GradingRubric *tmpl, bool write):
+  GradingRosterTool(root, part),
+  m_template(tmpl)
+{
+  m_write = write;
+  m_migrated = 0;
+}
+
+GradingMigrate::~GradingMigrate()
+{
+}
+
+size_t GradingMigrate::GetMigratedCount() const
+{
+  return m_migrated;
+}
+
+const std::vector<sMigrateRow> &GradingMigrate::GetRows() const
+{
+  return m_rows;
+}
+
+bool GradingMigrate::OnScan()
+{
+  m_rows.clear();
+  m_rows.resize(m_roster.GetCount());
+  for (size_t i = 0; i < m_rows.size(); i++)
+  {
+    m_rows[i].student = m_roster.GetStudent(i);
+    m_rows[i].migrated = m_rows[i].written = false;
+    m_rows[i].before = m_rows[i].after = 0.0f;
+    m_rows[i].migration.carried = 0;
+  }
+
+  return true;
+}
+
+void GradingMigrate::OnRunStart(int threads)
+{
+  m_migrated = 0;
+}
+
+void GradingMigrate::ProcessStudent(size_t index)
+{
+  sMigrateRow &row = m_rows[index];
+
+  GradingSheet sheet;
+  std::string gradeFilename;
+  if (ReadSheet(index, &sheet, &gradeFilename) != SHEET_READ)
+    return;
+
+  std::string scoreFilename = GradingSheet::ScoreFilename(gradeFilename);
+
+  if (sheet.GetRubric()->IsSameRubric(*m_template))
+    return;
+
+  row.before = sheet.m_totalPoints;
+  sheet.Migrate(m_template, &row.migration);
+  row.after = sheet.m_totalPoints;
+  row.migrated = true;
+
+  {
+    wxMutexLocker lock(m_mutex);
+    m_migrated++;
+  }
+
+  if (!m_write)
+    return;
+
+  if (!sheet.SaveScoreFile(scoreFilename))
+  {
+    AddError(row.student + ": couldn't write " + scoreFilename);
+    return;
+  }
+
+  if (!sheet.SaveGradeFile(gradeFilename))
+  {
+    AddError(row.student + ": couldn't write " + gradeFilename);
+    return;
+  }
+
+  row.written = true;
+}
+
+int GradingMigrate::Main(int argc, char **argv)
+{
+  bool write = argc == 6 && std::string(argv[5]) == "--write";
+  if ((argc != 5 && !write) || std::string(argv[1]) != "--migrate")
+  {
+    fprintf(stderr, "usage: %s --migrate <part> <roster root> <template> [--write]\n", argv[0]);
+    return 2;
+  }
+
+  sAssignmentPart part;
+  GradingSheet tmpl;
+  if (!LoadPart(argv[2], &part) || !LoadTemplate(argv[4], &tmpl))
+    return 1;
+
+  GradingMigrate migrate(argv[3], part, tmpl.GetRubric(), write);
+  if (!migrate.Scan())
+  {
+    fprintf(stderr, "I couldn't open the roster directory %s.\n", argv[3]);
+    return 1;
+  }
+
+  migrate.Run();
+
+  // Most students were graded with the same old template, so each different
+  // set of changes is only listed once.
+  const std::vector<sMigrateRow> &rows = migrate.GetRows();
+  std::vector<size_t> listed;
+  for (size_t i = 0; i < rows.size(); i++)
+  {
+    if (!rows[i].migrated)
+      continue;
+
+    bool seen = false;
+    for (size_t j = 0; j < listed.size() && !seen; j++)
+      seen = rows[listed[j]].migration.changes == rows[i].migration.changes;
+    if (seen)
+      continue;
+    listed.push_back(i);
+
+    size_t students = 0;
+    for (size_t j = i; j < rows.size(); j++)
+      if (rows[j].migrated && rows[j].migration.changes == rows[i].migration.changes)
+        students++;
+
+    printf("%u students (%s and so on) were graded with a template that differs from the new one:\n",
+      (unsigned int)students, rows[i].student.c_str());
+    for (size_t j = 0; j < rows[i].migration.changes.size(); j++)
+      printf("  %s\n", rows[i].migration.changes[j].c_str());
+    if (rows[i].migration.changes.size() == 0)
+      printf("  only in point values or text\n");
+  }
+
+  size_t flagged = 0;
+  for (size_t i = 0; i < rows.size(); i++)
+  {
+    const sMigrateRow &row = rows[i];
+    if (!row.migrated || (row.after == row.before && row.migration.lost.size() == 0 && row.migration.ambiguous.size() == 0))
+      continue;
+
+    printf("%s: %s -> %s, %d boxes carried over\n", row.student.c_str(),
+      formatFloat(row.before).c_str(), formatFloat(row.after).c_str(), row.migration.carried);
+    for (size_t j = 0; j < row.migration.lost.size(); j++)
+      printf("  lost: %s\n", row.migration.lost[j].c_str());
+    for (size_t j = 0; j < row.migration.ambiguous.size(); j++)
+      printf("  check: %s\n", row.migration.ambiguous[j].c_str());
+
+    if (row.migration.lost.size() > 0 || row.migration.ambiguous.size() > 0)
+      flagged++;
+  }
+
+  migrate.PrintErrors();
+  const std::vector<std::string> &errors = migrate.GetErrors();
+
+  if (write)
+    printf("Migrated %u of %u students; %u need checking (%u awaiting confirmation, %u errors).\n",
+      (unsigned int)migrate.GetMigratedCount(), (unsigned int)migrate.GetStudentCount(),
+      (unsigned int)flagged, (unsigned int)migrate.GetUnconfirmedCount(), (unsigned int)errors.size());
+  else
+    printf("Dry run: %u of %u students would be migrated; %u would need checking (%u awaiting confirmation, "
+      "%u errors). Nothing was written; add --write to do it.\n",
+      (unsigned int)migrate.GetMigratedCount(), (unsigned int)migrate.GetStudentCount(),
+      (unsigned int)flagged, (unsigned int)migrate.GetUnconfirmedCount(), (unsigned int)errors.size());
+
+  return errors.size() > 0;
+}
@@ -0,0 +1,52 @@
+#ifndef GRADINGMIGRATE_H
+#define GRADINGMIGRATE_H
+
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+#include "GradingRosterTool.h"
+
+// The migration moves every student's .ss sheet under the roster root onto a
+// revised template that has gained or lost categories, deductions or criteria
+// (see GradingSheet::Migrate for how things are matched up). It's a dry run
+// unless it's told to write: every sheet is migrated in memory and the report
+// says what would happen, but only a real run rewrites the .ss and grade
+// files. Students are handed out to a pool of worker threads (see
+// GradingRosterTool), and the results come out in roster order.
+
+struct sMigrateRow
+{
+  std::string student;
+  bool migrated;  // False if they have no sheet, it's already on the template, or only the tests have marked it.
+  bool written;
+  float before;
+  float after;
+  sMigration migration;
+};
+
+class GradingMigrate: public GradingRosterTool
+{
+  public:
+  GradingMigrate(std::string root, const sAssignmentPart &part, const GradingRubric *tmpl, bool write);
+  ~GradingMigrate();
+
+  size_t GetMigratedCount() const;
+  const std::vector<sMigrateRow> &GetRows() const;
+
+  // Command line entry point: grader --migrate <part> <roster root> <template> [--write]
+  static int Main(int argc, char **argv);
+
+  protected:
+  const GradingRubric *m_template;
+  bool m_write;
+
+  std::vector<sMigrateRow> m_rows;
+  size_t m_migrated;
+
+  bool OnScan();
+  void OnRunStart(int threads);
+  void ProcessStudent(size_t index);
+};
+
+#endif
@@ -0,0 +1,493 @@
+#include "GradingOutline.h"
+#include "GradingCore.h"
+
+#include <ctype.h>
+#include <string.h>
+
+// Plenty for a few rosters' worth of files; past that it starts over.
+const size_t GradingOutlineCache::MAX_OUTLINES = 20000;
+
+//-----Tokens-----
+
+enum {
+  TOKEN_WORD,     // Names and keywords.
+  TOKEN_SYMBOL,   // Always one character, so ">>" is two of them.
+  TOKEN_LITERAL   // Numbers, strings and characters.
+};
+
+struct sJavaToken
+{
+  int type;
+  const char *begin;
+  size_t length;
+  int line;
+};
+
+static bool IsWord(const sJavaToken &token, const char *word)
+{
+  return token.type == TOKEN_WORD && token.length == strlen(word) && memcmp(token.begin, word, token.length) == 0;
+}
+
+static bool IsSymbol(const sJavaToken &token, char symbol)
+{
+  return token.type == TOKEN_SYMBOL && *token.begin == symbol;
+}
+
+static bool IsWordChar(char c)
+{
+  return isalnum((unsigned char)c) || c == '_' || c == '$' || (unsigned char)c >= 0x80;
+}
+
+// Annotations can go anywhere a modifier can and never matter here, so they're
+// dropped: an '@', a name that might be dotted, and maybe arguments in
+// parentheses. "@interface" declares an annotation type, which is kept as an
+// interface.
+static void DropAnnotations(std::vector<sJavaToken> *tokens)
+{
+  std::vector<sJavaToken> &t = *tokens;
+  size_t kept = 0;
+
+  for (size_t i = 0; i < t.size(); i++)
+  {
+    if (!IsSymbol(t[i], '@'))
+    {
+      t[kept++] = t[i];
+      continue;
+    }
+
+    if (i + 1 >= t.size() || t[i + 1].type != TOKEN_WORD || IsWord(t[i + 1], "interface"))
+      continue;
+
+    i++;
+    while (i + 2 < t.size() && IsSymbol(t[i + 1], '.') && t[i + 2].type == TOKEN_WORD)
+      i += 2;
+
+    if (i + 1 < t.size() && IsSymbol(t[i + 1], '('))
+    {
+      int depth = 0;
+      for (i++; i < t.size(); i++)
+      {
+        if (IsSymbol(t[i], '('))
+          depth++;
+        else if (IsSymbol(t[i], ')') && --depth == 0)
+          break;
+      }
+    }
+  }
+
+  t.resize(kept);
+}
+
+// Splits a file into tokens, skipping comments and annotations.
+static void Tokenize(const char *data, size_t length, std::vector<sJavaToken> *tokens)
+{
+  const char *p = data, *end = data + length;
+  int line = 1;
+
+  while (p < end)
+  {
+    char c = *p;
+
+    if (c == '\n')
+    {
+      line++;
+      p++;
+      continue;
+    }
+
+    if (isspace((unsigned char)c))
+    {
+      p++;
+      continue;
+    }
+
+    if (c == '/' && p + 1 < end && p[1] == '/')
+    {
+      while (p < end && *p != '\n')
+        p++;
+      continue;
+    }
+
+    if (c == '/' && p + 1 < end && p[1] == '*')
+    {
+      for (p += 2; p < end && !(*p == '*' && p + 1 < end && p[1] == '/'); p++)
+      {
+        if (*p == '\n')
+          line++;
+      }
+      p = (p < end)?p + 2:end;
+      continue;
+    }
+
+    sJavaToken token;
+    token.begin = p;
+    token.line = line;
+
+    if (IsWordChar(c) && !isdigit((unsigned char)c))
+    {
+      token.type = TOKEN_WORD;
+      while (p < end && IsWordChar(*p))
+        p++;
+    }
+    else if (isdigit((unsigned char)c))
+    {
+      token.type = TOKEN_LITERAL;
+      while (p < end && (IsWordChar(*p) || *p == '.'))
+        p++;
+    }
+    else if (c == '"' || c == '\'')
+    {
+      // Literals stop at the end of the line, even if they weren't closed.
+      token.type = TOKEN_LITERAL;
+      for (p++; p < end && *p != c && *p != '\n'; p++)
+      {
+        if (*p == '\\' && p + 1 < end && p[1] != '\n')
+          p++;
+      }
+      if (p < end && *p == c)
+        p++;
+    }
+    else
+    {
+      token.type = TOKEN_SYMBOL;
+      p++;
+    }
+
+    token.length = p - token.begin;
+    tokens->push_back(token);
+  }
+
+  DropAnnotations(tokens);
+}
+
+//-----Outlines-----
+
+static const char *const MODIFIERS[] =
+{
+  "public", "protected", "private", "static", "final", "abstract", "synchronized", "native", "strictfp",
+  "default", "transient", "volatile"
+};
+
+// Words that can come right before a '(' without it being a method.
+static const char *const STATEMENTS[] =
+{
+  "if", "for", "while", "switch", "catch", "return", "synchronized", "new", "throw", "assert", "super", "this"
+};
+
+static bool IsOneOf(const sJavaToken &token, const char *const *words, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    if (IsWord(token, words[i]))
+      return true;
+  }
+
+  return false;
+}
+
+static bool IsModifier(const sJavaToken &token)
+{
+  return IsOneOf(token, MODIFIERS, sizeof(MODIFIERS) / sizeof(MODIFIERS[0]));
+}
+
+// Writes the tokens in [first, last) out as a type, without package names or
+// any spaces that don't separate words.
+static std::string BuildType(const std::vector<sJavaToken> &tokens, size_t first, size_t last)
+{
+  std::string type;
+
+  for (size_t i = first; i < last; i++)
+  {
+    const sJavaToken &token = tokens[i];
+
+    if (token.type == TOKEN_WORD && i + 2 < last && IsSymbol(tokens[i + 1], '.') && tokens[i + 2].type == TOKEN_WORD)
+    {
+      i++;
+      continue;
+    }
+
+    if (token.type == TOKEN_WORD && !type.empty() && (IsWordChar(type[type.length() - 1]) || type[type.length() - 1] == '?'))
+      type += ' ';
+    type.append(token.begin, token.length);
+    if (IsSymbol(token, ','))
+      type += ' ';
+  }
+
+  return type;
+}
+
+// Works out a parameter's type from its tokens in [first, last). Templates
+// can leave the names off, so a parameter that's only a type is fine too.
+static bool ReadParameter(const std::vector<sJavaToken> &tokens, size_t first, size_t last, std::string *type)
+{
+  while (first < last && IsWord(tokens[first], "final"))
+    first++;
+
+  std::string brackets;
+  while (last - first >= 2 && IsSymbol(tokens[last - 2], '[') && IsSymbol(tokens[last - 1], ']'))
+  {
+    brackets += "[]";
+    last -= 2;
+  }
+
+  if (first == last)
+    return false;
+
+  for (size_t i = first; i < last; i++)
+  {
+    if (tokens[i].type == TOKEN_LITERAL)
+      return false;
+  }
+
+  // The name is the last word, unless that's the end of a dotted type name
+  // ("java.util.Scanner"). Varargs ("String... args") still have one, though.
+  // "int a[]" is an int[] called a.
+  if (last - first >= 2 && tokens[last - 1].type == TOKEN_WORD &&
+    (!IsSymbol(tokens[last - 2], '.') || (last - first >= 4 && IsSymbol(tokens[last - 3], '.'))))
+    last--;
+
+  *type = BuildType(tokens, first, last) + brackets;
+  return true;
+}
+
+// Reads a method header from its first token to the '(' of its parameters,
+// which has to come right after its name. On success, after is the token
+// right after the ')'.
+static bool ReadMethod(const std::vector<sJavaToken> &tokens, size_t first, size_t open, sJavaMethod *method, size_t *after)
+{
+  if (open <= first || tokens[open - 1].type != TOKEN_WORD ||
+    IsOneOf(tokens[open - 1], STATEMENTS, sizeof(STATEMENTS) / sizeof(STATEMENTS[0])))
+    return false;
+
+  // Anything with '=' or a ',' outside of angle brackets in front of it is a
+  // field or an enum constant, not a method.
+  int angles = 0;
+  for (size_t i = first; i + 1 < open; i++)
+  {
+    if (IsSymbol(tokens[i], '<'))
+      angles++;
+    else if (IsSymbol(tokens[i], '>'))
+      angles--;
+    else if (IsSymbol(tokens[i], '=') || IsSymbol(tokens[i], '(') || IsSymbol(tokens[i], ')') ||
+      (IsSymbol(tokens[i], ',') && angles <= 0) || tokens[i].type == TOKEN_LITERAL)
+      return false;
+  }
+
+  // Modifiers, then maybe the method's own type parameters, then the type.
+  size_t start = first;
+  while (start + 1 < open && IsModifier(tokens[start]))
+    start++;
+  if (start + 1 < open && IsSymbol(tokens[start], '<'))
+  {
+    for (angles = 0; start + 1 < open; start++)
+    {
+      if (IsSymbol(tokens[start], '<'))
+        angles++;
+      else if (IsSymbol(tokens[start], '>') && --angles == 0)
+      {
+        start++;
+        break;
+      }
+    }
+  }
+
+  method->returnType = BuildType(tokens, start, open - 1);
+  method->name.assign(tokens[open - 1].begin, tokens[open - 1].length);
+  method->parameters.clear();
+  method->line = tokens[open - 1].line;
+
+  // The parameters, split on commas that aren't inside a generic type.
+  size_t i = open + 1, parameter = i;
+  int parens = 1;
+  angles = 0;
+  for (; i < tokens.size(); i++)
+  {
+    const sJavaToken &token = tokens[i];
+
+    if (IsSymbol(token, '('))
+      parens++;
+    else if (IsSymbol(token, '<'))
+      angles++;
+    else if (IsSymbol(token, '>'))
+      angles--;
+    else if (IsSymbol(token, '{') || IsSymbol(token, '}') || IsSymbol(token, ';') || IsSymbol(token, '='))
+      return false;
+
+    bool closed = IsSymbol(token, ')') && --parens == 0;
+    if (closed || (IsSymbol(token, ',') && parens == 1 && angles <= 0))
+    {
+      std::string type;
+      if (!closed || i > parameter || method->parameters.size() > 0)
+      {
+        if (!ReadParameter(tokens, parameter, i, &type))
+          return false;
+        method->parameters.push_back(type);
+      }
+      parameter = i + 1;
+    }
+
+    if (closed)
+      break;
+  }
+
+  if (i >= tokens.size())
+    return false;
+
+  // Old-style arrays can have their brackets after the parameters.
+  for (i++; i + 1 < tokens.size() && IsSymbol(tokens[i], '[') && IsSymbol(tokens[i + 1], ']'); i += 2)
+    method->returnType += "[]";
+
+  *after = i;
+  return true;
+}
+
+void IndexJava(const char *data, size_t length, sJavaOutline *outline)
+{
+  outline->classes.clear();
+
+  std::vector<sJavaToken> tokens;
+  Tokenize(data, length, &tokens);
+
+  std::vector<int> scopes;  // For each open brace, the class whose body it is, or -1.
+  int pending = -1;         // A class whose body hasn't started yet.
+  size_t statement = 0;     // Where the current declaration started.
+
+  for (size_t i = 0; i < tokens.size(); i++)
+  {
+    const sJavaToken &token = tokens[i];
+    int scope = scopes.empty()?-1:scopes.back();
+
+    if ((IsWord(token, "class") || IsWord(token, "interface") || IsWord(token, "enum")) &&
+      (i == 0 || !IsSymbol(tokens[i - 1], '.')) && i + 1 < tokens.size() && tokens[i + 1].type == TOKEN_WORD)
+    {
+      sJavaClass found;
+      found.kind.assign(token.begin, token.length);
+      found.name.assign(tokens[i + 1].begin, tokens[i + 1].length);
+      if (scope >= 0)
+        found.name = outline->classes[scope].name + '.' + found.name;
+      found.line = tokens[i + 1].line;
+
+      outline->classes.push_back(found);
+      pending = outline->classes.size() - 1;
+      i++;
+    }
+    else if (IsSymbol(token, '{'))
+    {
+      scopes.push_back(pending);
+      pending = -1;
+      statement = i + 1;
+    }
+    else if (IsSymbol(token, '}'))
+    {
+      if (!scopes.empty())
+        scopes.pop_back();
+      statement = i + 1;
+    }
+    else if (IsSymbol(token, ';'))
+      statement = i + 1;
+    else if (IsSymbol(token, '(') && scope >= 0 && pending < 0)
+    {
+      sJavaMethod method;
+      size_t after;
+      if (!ReadMethod(tokens, statement, i, &method, &after))
+        continue;
+
+      if (after < tokens.size() && IsWord(tokens[after], "throws"))
+      {
+        while (after < tokens.size() && !IsSymbol(tokens[after], '{') && !IsSymbol(tokens[after], ';'))
+          after++;
+      }
+
+      // Only something with a body (or a ';', for abstract methods) is a
+      // declaration. Constructors have to be named after their class.
+      if (after >= tokens.size() || !(IsSymbol(tokens[after], '{') || IsSymbol(tokens[after], ';')))
+        continue;
+
+      sJavaClass &owner = outline->classes[scope];
+      if (method.returnType.empty() && owner.name.substr(owner.name.find_last_of('.') + 1) != method.name)
+        continue;
+
+      owner.methods.push_back(method);
+      i = after - 1;
+    }
+  }
+}
+
+// Reads a header like "public static String reverse(String s)", the way a
+// template would write it. Parameter names can be left out.
+bool ParseJavaSignature(std::string text, sJavaMethod *method)
+{
+  std::vector<sJavaToken> tokens;
+  Tokenize(text.c_str(), text.length(), &tokens);
+
+  size_t open = 0;
+  while (open < tokens.size() && !IsSymbol(tokens[open], '('))
+    open++;
+
+  size_t after;
+  if (open == tokens.size() || !ReadMethod(tokens, 0, open, method, &after))
+    return false;
+
+  method->line = 0;
+  return after == tokens.size() || (after + 1 == tokens.size() && IsSymbol(tokens[after], ';'));
+}
+
+bool IsJavaFile(std::string filename)
+{
+  if (filename.length() < 5)
+    return false;
+
+  std::string extension = filename.substr(filename.length() - 5);
+  for (size_t i = 0; i < extension.length(); i++)
+    extension[i] = tolower((unsigned char)extension[i]);
+  return extension == ".java";
+}
+
+std::string sJavaMethod::GetParameterList() const
+{
+  std::string list = "(";
+  for (size_t i = 0; i < parameters.size(); i++)
+    list += ((i > 0)?", ":"") + parameters[i];
+  return list + ")";
+}
+
+std::string sJavaMethod::ToString() const
+{
+  return returnType + (returnType.empty()?"":" ") + name + GetParameterList();
+}
+
+//-----GradingOutlineCache-----
+
+GradingOutlineCache::GradingOutlineCache()
+{
+}
+
+// Files are indexed outside the lock, so two threads might both index the same
+// new file; the second one just puts the same outline back.
+void GradingOutlineCache::Index(const char *data, size_t length, sJavaOutline *outline, unsigned int hash)
+{
+  Key key((hash != 0)?hash:HashContent(data, length), length);
+  {
+    wxMutexLocker lock(m_mutex);
+
+    std::map<Key, sJavaOutline>::const_iterator it = m_outlines.find(key);
+    if (it != m_outlines.end())
+    {
+      *outline = it->second;
+      return;
+    }
+  }
+
+  IndexJava(data, length, outline);
+
+  wxMutexLocker lock(m_mutex);
+  if (m_outlines.size() >= MAX_OUTLINES)
+    m_outlines.clear();
+  m_outlines[key] = *outline;
+}
+
+void GradingOutlineCache::Clear()
+{
+  wxMutexLocker lock(m_mutex);
+  m_outlines.clear();
+}
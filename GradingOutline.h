@@ -0,0 +1,73 @@
+#ifndef GRADINGOUTLINE_H
+#define GRADINGOUTLINE_H
+
+#include <wx/thread.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// An outline is every class and method declared in a Java file, with the line
+// it's on. It's pulled out of the file's tokens with a few rules of thumb
+// instead of a real parser: a method is a name and a parameter list, in a
+// class's body, followed by a body or a ';'. That's fast, and good enough for
+// the code students turn in, including code that doesn't compile.
+//
+// Types are kept the way they'd be written, minus package names and spaces
+// (except between words), so "java.util.List<String>" is "List<String>" and
+// "String args[]" is "String[]". Methods are listed under the class they're
+// declared in, with nested classes named like "Outer.Inner". Constructors have
+// an empty return type.
+
+struct sJavaMethod
+{
+  std::string returnType;
+  std::string name;
+  std::vector<std::string> parameters;  // Just the types.
+  int line;
+
+  std::string GetParameterList() const;
+  std::string ToString() const;
+};
+
+struct sJavaClass
+{
+  std::string kind;  // "class", "interface" or "enum".
+  std::string name;
+  int line;
+  std::vector<sJavaMethod> methods;
+};
+
+struct sJavaOutline
+{
+  std::vector<sJavaClass> classes;
+};
+
+void IndexJava(const char *data, size_t length, sJavaOutline *outline);
+bool ParseJavaSignature(std::string text, sJavaMethod *method);
+bool IsJavaFile(std::string filename);
+
+// The outline cache keeps every outline it's made, by a hash of the file it
+// came from, so a file that's indexed again (the same student opened twice,
+// or the starter code everybody handed back unchanged) is just copied. It's
+// shared by every thread that indexes files. If the file's hash is already
+// known (from the manifest), it can be passed in instead of being worked out.
+
+class GradingOutlineCache
+{
+  public:
+  GradingOutlineCache();
+
+  void Index(const char *data, size_t length, sJavaOutline *outline, unsigned int hash = 0);
+  void Clear();
+
+  static const size_t MAX_OUTLINES;
+
+  protected:
+  typedef std::pair<unsigned int, size_t> Key;  // The file's hash and length.
+
+  wxMutex m_mutex;
+  std::map<Key, sJavaOutline> m_outlines;
+};
+
+#endif
@@ -0,0 +1,233 @@
+
+#include "GradingPrefetch.h"
+
+#include <wx/dir.h>
+
+//-----sStudentFiles-----
+
+sStudentFiles::sStudentFiles()
+{
+  opened = false;
+  sheetLoaded = false;
+  graded = false;
+  sheetError.line = sheetError.column = 0;
+}
+
+sStudentFiles::~sStudentFiles()
+{
+  Clear();
+}
+
+void sStudentFiles::Clear()
+{
+  for (size_t i = 0; i < submissions.size(); i++)
+    delete submissions[i].view;
+
+  directory.clear();
+  opened = false;
+  submissions.clear();
+  gradeFilename.clear();
+  sheetLoaded = false;
+  graded = false;
+  sheetError.line = sheetError.column = 0;
+  sheetError.message.clear();
+  sheet.Clear();
+  outlines.clear();
+  suggestions.clear();
+}
+
+void sStudentFiles::Swap(sStudentFiles &files)
+{
+  directory.swap(files.directory);
+  std::swap(opened, files.opened);
+  submissions.swap(files.submissions);
+  gradeFilename.swap(files.gradeFilename);
+  std::swap(sheetLoaded, files.sheetLoaded);
+  std::swap(graded, files.graded);
+  std::swap(sheetError, files.sheetError);
+  sheet.Swap(files.sheet);
+  outlines.swap(files.outlines);
+  suggestions.swap(files.suggestions);
+}
+
+// Reads a student's directory the same way whether it's on the UI thread or
+// the prefetcher's. It never shows anything; the caller decides what to complain about.
+// With a manifest, the directory is only listed if it's changed since last time,
+// and its files were already sorted out for every part when it was. With an
+// outline cache, Java submissions are indexed, and with a matcher, they're all
+// checked against the rules, while they're still fresh in memory.
+void ReadStudentFiles(std::string directory, const sAssignmentPart &part, const GradingRubric *tmpl, sStudentFiles *files,
+  GradingManifest *manifest, GradingRuleMatcher *matcher, GradingOutlineCache *outlines)
+{
+  files->Clear();
+  files->directory = directory;
+
+  sPartFiles found;
+  if (manifest && manifest->GetPartFiles(directory, part, &found))
+    files->opened = true;
+  else
+  {
+    wxDir dir(directory);
+    files->opened = dir.IsOpened();
+    if (!files->opened)
+      return;
+
+    wxString filename;
+    bool more = dir.GetFirst(&filename, part.submissionFilter, wxDIR_FILES);
+    while (more)
+    {
+      found.submissions.push_back(filename.c_str());
+      more = dir.GetNext(&filename);
+    }
+
+    if (dir.GetFirst(&filename, part.gradeFileFilter, wxDIR_FILES))
+      found.gradeFilename = filename.c_str();
+
+    if (dir.GetFirst(&filename, "*.ss", wxDIR_FILES))
+      found.scoreFilename = filename.c_str();
+  }
+
+  for (size_t i = 0; i < found.submissions.size(); i++)
+  {
+    sStudentFile file;
+    file.filename = found.submissions[i];
+    file.view = new GradingFileView();
+    file.loaded = file.view->Open(directory + '/' + file.filename);
+    if (file.loaded)
+      file.view->Touch();
+
+    unsigned long size;
+    if (!manifest || !file.loaded || !manifest->GetFileHash(directory, file.filename, &file.hash, &size) ||
+      size != file.view->GetLength())
+      file.hash = 0;
+    files->submissions.push_back(file);
+  }
+
+  files->outlines.resize(files->submissions.size());
+  for (size_t i = 0; outlines && i < files->submissions.size(); i++)
+  {
+    const sStudentFile &file = files->submissions[i];
+    if (file.loaded && IsJavaFile(file.filename))
+      outlines->Index(file.view->GetData(), file.view->GetLength(), &files->outlines[i], file.hash);
+  }
+
+  if (matcher && files->submissions.size() > 0)
+  {
+    matcher->Begin();
+    for (size_t i = 0; i < files->submissions.size(); i++)
+    {
+      const sStudentFile &file = files->submissions[i];
+      if (file.loaded)
+        matcher->AddFile(file.filename, file.view->GetData(), file.view->GetLength(), file.hash);
+    }
+    matcher->Finish(&files->suggestions);
+  }
+
+  // The official grade file
+  if (!found.gradeFilename.empty())
+    files->gradeFilename = directory + '/' + found.gradeFilename;
+
+  // The score sheet generated by this program
+  files->graded = !found.scoreFilename.empty();
+  if (files->graded)
+    files->sheetLoaded = files->sheet.Load(directory + '/' + found.scoreFilename, &files->sheetError);
+  else
+  {
+    files->sheet.SetRubric(tmpl);
+    files->sheetLoaded = (tmpl != NULL);
+    if (!files->sheetLoaded)
+      files->sheetError.message = "the template couldn't be read";
+  }
+}
+
+//-----GradingPrefetch-----
+
+GradingPrefetch::GradingPrefetch(const sAssignmentPart &part, const GradingRubric *tmpl, GradingWriter *writer,
+  GradingManifest *manifest, const std::vector<sRule> *rules, GradingOutlineCache *outlines):
+  wxThread(wxTHREAD_JOINABLE),
+  m_part(part),
+  m_template(tmpl),
+  m_writer(writer),
+  m_manifest(manifest),
+  m_outlines(outlines),
+  m_condition(m_mutex)
+{
+  m_stop = false;
+
+  // The prefetcher gets its own copy of the rules, since it checks students on
+  // its own thread.
+  m_matcher = (rules && rules->size() > 0)?new GradingRuleMatcher(*rules, outlines):NULL;
+}
+
+GradingPrefetch::~GradingPrefetch()
+{
+  delete m_matcher;
+}
+
+void GradingPrefetch::Request(std::string directory)
+{
+  wxMutexLocker lock(m_mutex);
+
+  if (directory == m_working || directory == m_ready.directory)
+    return;
+
+  m_requested = directory;
+  m_condition.Broadcast();
+}
+
+// Hands over the prefetched files if they're for the given directory. If that
+// directory is still being read, this waits for it, since that's never slower
+// than starting over. Returns false if it was never asked for.
+bool GradingPrefetch::Take(std::string directory, sStudentFiles *files)
+{
+  wxMutexLocker lock(m_mutex);
+
+  while (!m_stop && (m_working == directory || m_requested == directory))
+    m_condition.Wait();
+
+  if (m_ready.directory != directory)
+    return false;
+
+  files->Swap(m_ready);
+  m_ready.Clear();
+  return true;
+}
+
+void GradingPrefetch::Stop()
+{
+  wxMutexLocker lock(m_mutex);
+
+  m_stop = true;
+  m_condition.Broadcast();
+}
+
+wxThread::ExitCode GradingPrefetch::Entry()
+{
+  wxMutexLocker lock(m_mutex);
+
+  while (!m_stop)
+  {
+    if (m_requested.empty())
+    {
+      m_condition.Wait();
+      continue;
+    }
+
+    m_working.swap(m_requested);
+    m_requested.clear();
+    m_ready.Clear();
+
+    m_mutex.Unlock();
+    sStudentFiles files;
+    if (m_writer)
+      m_writer->WaitFor(m_working);
+    ReadStudentFiles(m_working, m_part, m_template, &files, m_manifest, m_matcher, m_outlines);
+    m_mutex.Lock();
+
+    m_ready.Swap(files);
+    m_working.clear();
+    m_condition.Broadcast();
+  }
+
+  return 0;
+}
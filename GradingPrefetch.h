@@ -0,0 +1,91 @@
+#ifndef GRADINGPREFETCH_H
+#define GRADINGPREFETCH_H
+
+#include <wx/thread.h>
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+#include "GradingManifest.h"
+#include "GradingRules.h"
+#include "GradingWriter.h"
+
+// Everything GradingTools needs from a student's directory to show them: the
+// submission files that match the part's filter, the grade file's name, and
+// the parsed score sheet (or a blank one on the template's rubric, if they
+// haven't been graded yet), plus the outlines of their Java files and whatever
+// the template's rules suggest for them. The template rubric is only ever read,
+// so the prefetcher can share it with the UI thread.
+
+struct sStudentFile
+{
+  std::string filename;
+  GradingFileView *view;  // Owned by the sStudentFiles this is in.
+  bool loaded;
+  unsigned int hash;  // Of the contents, from the manifest; 0 if it wasn't known.
+};
+
+struct sStudentFiles
+{
+  sStudentFiles();
+  ~sStudentFiles();
+
+  std::string directory;
+  bool opened;
+
+  std::vector<sStudentFile> submissions;
+  std::string gradeFilename;
+
+  bool sheetLoaded;
+  bool graded;  // Whether the sheet came from their .ss, not the template.
+  sParseError sheetError;  // Why the sheet wasn't loaded, if it wasn't.
+  GradingSheet sheet;
+  std::vector<sJavaOutline> outlines;  // One for each submission; empty if it isn't Java.
+  std::vector<sRuleSuggestion> suggestions;
+
+  void Clear();
+  void Swap(sStudentFiles &files);
+
+  private:
+  sStudentFiles(const sStudentFiles &);
+  sStudentFiles &operator=(const sStudentFiles &);
+};
+
+void ReadStudentFiles(std::string directory, const sAssignmentPart &part, const GradingRubric *tmpl, sStudentFiles *files,
+  GradingManifest *manifest = NULL, GradingRuleMatcher *matcher = NULL, GradingOutlineCache *outlines = NULL);
+
+// The prefetcher reads the next student's directory on a background thread
+// while the current one is being graded, so switching students only has to swap
+// the prepared files in instead of waiting on the file server. It only holds on
+// to one student at a time; asking for another one replaces it.
+
+class GradingPrefetch: public wxThread
+{
+  public:
+  GradingPrefetch(const sAssignmentPart &part, const GradingRubric *tmpl, GradingWriter *writer = NULL,
+    GradingManifest *manifest = NULL, const std::vector<sRule> *rules = NULL, GradingOutlineCache *outlines = NULL);
+  ~GradingPrefetch();
+
+  void Request(std::string directory);
+  bool Take(std::string directory, sStudentFiles *files);
+  void Stop();
+
+  protected:
+  sAssignmentPart m_part;
+  const GradingRubric *m_template;
+  GradingWriter *m_writer;  // Saves to wait for before reading a directory back.
+  GradingManifest *m_manifest;
+  GradingRuleMatcher *m_matcher;  // NULL if there aren't any rules.
+  GradingOutlineCache *m_outlines;
+
+  wxMutex m_mutex;
+  wxCondition m_condition;
+  std::string m_requested;  // Waiting to be read; empty if there's nothing to do.
+  std::string m_working;    // Being read right now.
+  sStudentFiles m_ready;
+  bool m_stop;
+
+  ExitCode Entry();
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "GradingRegrade.h"
+
+#include <stdio.h>
+
+GradingRegrade::GradingRegrade(std::string root, const sAssignmentPart &part, const GradingRubric *tmpl):
+  GradingRosterTool(root, part),
+  m_template(tmpl)
+{
+  m_rewritten = 0;
+}
+
+GradingRegrade::~GradingRegrade()
+{
+}
+
+size_t GradingRegrade::GetRewrittenCount() const
+{
+  return m_rewritten;
+}
+
+const std::vector<sRegradeRow> &GradingRegrade::GetRows() const
+{
+  return m_rows;
+}
+
+bool GradingRegrade::OnScan()
+{
+  m_rows.clear();
+  m_rows.resize(m_roster.GetCount());
+  for (size_t i = 0; i < m_rows.size(); i++)
+  {
+    m_rows[i].student = m_roster.GetStudent(i);
+    m_rows[i].regraded = m_rows[i].rewritten = false;
+    m_rows[i].before = m_rows[i].after = 0.0f;
+    m_rows[i].unmatched = 0;
+  }
+
+  return true;
+}
+
+void GradingRegrade::OnRunStart(int threads)
+{
+  m_rewritten = 0;
+}
+
+void GradingRegrade::ProcessStudent(size_t index)
+{
+  sRegradeRow &row = m_rows[index];
+
+  GradingSheet sheet;
+  std::string gradeFilename;
+  if (ReadSheet(index, &sheet, &gradeFilename) != SHEET_READ)
+    return;
+
+  std::string scoreFilename = GradingSheet::ScoreFilename(gradeFilename);
+
+  GradingRubric old(*sheet.GetRubric());
+  row.before = sheet.m_totalPoints;
+  row.unmatched = sheet.TakeValues(*m_template);
+  row.after = sheet.m_totalPoints;
+  row.regraded = true;
+
+  if (sheet.GetRubric()->HasSameStructure(old))
+    return;
+
+  if (!sheet.SaveScoreFile(scoreFilename))
+  {
+    AddError(row.student + ": couldn't write " + scoreFilename);
+    return;
+  }
+
+  if (!sheet.SaveGradeFile(gradeFilename))
+  {
+    AddError(row.student + ": couldn't write " + gradeFilename);
+    return;
+  }
+
+  row.rewritten = true;
+
+  wxMutexLocker lock(m_mutex);
+  m_rewritten++;
+}
+
+int GradingRegrade::Main(int argc, char **argv)
+{
+  if (argc != 5 || std::string(argv[1]) != "--regrade")
+  {
+    fprintf(stderr, "usage: %s --regrade <part> <roster root> <template>\n", argv[0]);
+    return 2;
+  }
+
+  sAssignmentPart part;
+  GradingSheet tmpl;
+  if (!LoadPart(argv[2], &part) || !LoadTemplate(argv[4], &tmpl))
+    return 1;
+
+  GradingRegrade regrade(argv[3], part, tmpl.GetRubric());
+  if (!regrade.Scan())
+  {
+    fprintf(stderr, "I couldn't open the roster directory %s.\n", argv[3]);
+    return 1;
+  }
+
+  regrade.Run();
+
+  // Everyone whose score moved, and by how much.
+  const std::vector<sRegradeRow> &rows = regrade.GetRows();
+  size_t changed = 0;
+  for (size_t i = 0; i < rows.size(); i++)
+  {
+    if (!rows[i].regraded || rows[i].after == rows[i].before)
+      continue;
+
+    std::string delta = formatFloat(rows[i].after - rows[i].before);
+    if (rows[i].after > rows[i].before)
+      delta = "+" + delta;
+
+    printf("%s: %s -> %s (%s)\n", rows[i].student.c_str(),
+      formatFloat(rows[i].before).c_str(), formatFloat(rows[i].after).c_str(), delta.c_str());
+    changed++;
+  }
+
+  for (size_t i = 0; i < rows.size(); i++)
+    if (rows[i].unmatched > 0)
+      fprintf(stderr, "%s: %d deductions weren't in the template and kept their old values\n",
+        rows[i].student.c_str(), rows[i].unmatched);
+
+  regrade.PrintErrors();
+  const std::vector<std::string> &errors = regrade.GetErrors();
+
+  printf("Rewrote %u of %u students; %u scores changed (%u awaiting confirmation, %u errors).\n",
+    (unsigned int)regrade.GetRewrittenCount(), (unsigned int)regrade.GetStudentCount(),
+    (unsigned int)changed, (unsigned int)regrade.GetUnconfirmedCount(), (unsigned int)errors.size());
+
+  return errors.size() > 0;
+}
@@ -0,0 +1,51 @@
+#ifndef GRADINGREGRADE_H
+#define GRADINGREGRADE_H
+
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+#include "GradingRosterTool.h"
+
+// The regrade takes an edited template and puts its point values into every
+// student's .ss sheet under the roster root, keeping whatever boxes they had
+// checked (see GradingRubric::TakeValues for how things are matched up). Anyone
+// whose sheet changed gets their .ss and grade file rewritten, the same way
+// the save button would write them. Students are handed out to a pool of
+// worker threads (see GradingRosterTool), and the results come out in roster
+// order.
+
+struct sRegradeRow
+{
+  std::string student;
+  bool regraded;   // False if they don't have a score sheet yet, or only the tests have marked it.
+  bool rewritten;  // True if the template changed anything on their sheet.
+  float before;
+  float after;
+  int unmatched;   // Deductions that kept their old values.
+};
+
+class GradingRegrade: public GradingRosterTool
+{
+  public:
+  GradingRegrade(std::string root, const sAssignmentPart &part, const GradingRubric *tmpl);
+  ~GradingRegrade();
+
+  size_t GetRewrittenCount() const;
+  const std::vector<sRegradeRow> &GetRows() const;
+
+  // Command line entry point: grader --regrade <part> <roster root> <template>
+  static int Main(int argc, char **argv);
+
+  protected:
+  const GradingRubric *m_template;
+
+  std::vector<sRegradeRow> m_rows;
+  size_t m_rewritten;
+
+  bool OnScan();
+  void OnRunStart(int threads);
+  void ProcessStudent(size_t index);
+};
+
+#endif
@@ -0,0 +1,146 @@
+
+#include "GradingRoster.h"
+
+#include <ctype.h>
+#include <algorithm>
+
+static const std::string s_noStudent;
+
+GradingRoster::GradingRoster()
+{
+  m_current = -1;
+}
+
+bool GradingRoster::Open(std::string root)
+{
+  m_root = root;
+  m_students.clear();
+  m_current = -1;
+
+  if (!m_manifest.Open(root))
+    return false;
+
+  for (size_t i = 0; i < m_manifest.GetCount(); i++)
+    m_students.push_back(m_manifest.GetStudent(i));
+
+  std::sort(m_students.begin(), m_students.end(), NaturalLess);
+
+  return true;
+}
+
+std::string GradingRoster::GetRoot() const
+{
+  return m_root;
+}
+
+size_t GradingRoster::GetCount() const
+{
+  return m_students.size();
+}
+
+const std::string &GradingRoster::GetStudent(size_t index) const
+{
+  return m_students[index];
+}
+
+std::string GradingRoster::GetStudentPath(size_t index) const
+{
+  return m_root + '/' + m_students[index];
+}
+
+// Returns the student's index in the roster, or -1 if they aren't in it.
+int GradingRoster::Find(std::string student) const
+{
+  std::vector<std::string>::const_iterator it = std::lower_bound(m_students.begin(), m_students.end(), student, NaturalLess);
+
+  if (it == m_students.end() || *it != student)
+    return -1;
+
+  return it - m_students.begin();
+}
+
+GradingManifest *GradingRoster::GetManifest()
+{
+  return &m_manifest;
+}
+
+int GradingRoster::GetCurrent() const
+{
+  return m_current;
+}
+
+const std::string &GradingRoster::GetCurrentStudent() const
+{
+  if (m_current < 0)
+    return s_noStudent;
+
+  return m_students[m_current];
+}
+
+bool GradingRoster::SetCurrent(std::string student)
+{
+  int index = Find(student);
+  if (index < 0)
+    return false;
+
+  m_current = index;
+  return true;
+}
+
+// Moves d students forward (or backward, if negative). Returns false and stays
+// put if that would fall off either end of the roster.
+bool GradingRoster::Shift(int d)
+{
+  int index = m_current + d;
+  if (m_current < 0 || index < 0 || index >= (int)m_students.size())
+    return false;
+
+  m_current = index;
+  return true;
+}
+
+// Compares runs of digits by their numeric value and everything else without
+// regard to case. Names that only differ in case or leading zeroes fall back to
+// a plain comparison, so the order is always total and stable.
+bool GradingRoster::NaturalLess(const std::string &a, const std::string &b)
+{
+  size_t i = 0, j = 0;
+
+  while (i < a.length() && j < b.length())
+  {
+    if (isdigit((unsigned char)a[i]) && isdigit((unsigned char)b[j]))
+    {
+      while (i < a.length() && a[i] == '0')
+        i++;
+      while (j < b.length() && b[j] == '0')
+        j++;
+
+      size_t startA = i, startB = j;
+      while (i < a.length() && isdigit((unsigned char)a[i]))
+        i++;
+      while (j < b.length() && isdigit((unsigned char)b[j]))
+        j++;
+
+      // More significant digits means a bigger number
+      if (i - startA != j - startB)
+        return i - startA < j - startB;
+
+      int c = a.compare(startA, i - startA, b, startB, j - startB);
+      if (c != 0)
+        return c < 0;
+    }
+    else
+    {
+      int ca = tolower((unsigned char)a[i]), cb = tolower((unsigned char)b[j]);
+      if (ca != cb)
+        return ca < cb;
+      i++;
+      j++;
+    }
+  }
+
+  if (i < a.length() || j < b.length())
+    return j < b.length();
+
+  return a < b;
+}
@@ -0,0 +1,44 @@
+#ifndef GRADINGROSTER_H
+#define GRADINGROSTER_H
+
+#include <string>
+#include <vector>
+
+#include "GradingManifest.h"
+
+// The roster is the list of student directories under the roster root. It's
+// read once when the session starts and kept sorted in natural order, so
+// "s2" comes before "s10" no matter what order the filesystem hands them back
+// in. Moving to the previous or next student is then just an index step. The
+// students come from the roster's manifest, so the root usually doesn't have
+// to be listed at all.
+
+class GradingRoster
+{
+  public:
+  GradingRoster();
+
+  bool Open(std::string root);
+
+  std::string GetRoot() const;
+  size_t GetCount() const;
+  const std::string &GetStudent(size_t index) const;
+  std::string GetStudentPath(size_t index) const;
+  int Find(std::string student) const;
+  GradingManifest *GetManifest();
+
+  int GetCurrent() const;
+  const std::string &GetCurrentStudent() const;
+  bool SetCurrent(std::string student);
+  bool Shift(int d);
+
+  static bool NaturalLess(const std::string &a, const std::string &b);
+
+  protected:
+  std::string m_root;
+  std::vector<std::string> m_students;
+  int m_current;
+  GradingManifest m_manifest;
+};
+
+#endif
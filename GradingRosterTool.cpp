@@ -0,0 +1,226 @@
+#include "GradingRosterTool.h"
+
+#include <wx/filefn.h>
+#include <stdio.h>
+
+//-----GradingRosterTool::Worker-----
+
+GradingRosterTool::Worker::Worker(GradingRosterTool *tool):
+  wxThread(wxTHREAD_JOINABLE),
+  m_tool(tool)
+{
+}
+
+wxThread::ExitCode GradingRosterTool::Worker::Entry()
+{
+  size_t index;
+  while (m_tool->NextStudent(&index))
+    m_tool->ProcessStudent(index);
+
+  return 0;
+}
+
+//-----GradingRosterTool-----
+
+GradingRosterTool::GradingRosterTool(std::string root, const sAssignmentPart &part):
+  m_root(root),
+  m_part(part)
+{
+  m_next = 0;
+  m_unconfirmed = 0;
+}
+
+GradingRosterTool::~GradingRosterTool()
+{
+}
+
+// Scan collects the student directories under the roster root. It has to happen
+// before Run, and on the calling thread.
+bool GradingRosterTool::Scan()
+{
+  if (!m_roster.Open(m_root))
+    return false;
+  m_roster.GetManifest()->SetParts(std::vector<sAssignmentPart>(1, m_part));
+
+  return OnScan();
+}
+
+void GradingRosterTool::Run(int threads)
+{
+  if (threads <= 0)
+    threads = wxThread::GetCPUCount();
+  if (threads <= 0)
+    threads = 1;
+  if ((size_t)threads > m_roster.GetCount())
+    threads = m_roster.GetCount();
+
+  m_next = 0;
+  m_unconfirmed = 0;
+  OnRunStart(threads);
+
+  std::vector<Worker *> workers;
+  for (int i = 0; i < threads; i++)
+  {
+    Worker *worker = new Worker(this);
+    if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR)
+    {
+      delete worker;
+      continue;
+    }
+    workers.push_back(worker);
+  }
+
+  // If no threads could be started at all, just do the work here.
+  if (workers.size() == 0)
+  {
+    size_t index;
+    while (NextStudent(&index))
+      ProcessStudent(index);
+  }
+
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    workers[i]->Wait();
+    delete workers[i];
+  }
+
+  OnRunEnd();
+
+  // Whatever got listed along the way won't have to be listed again next time.
+  if (m_roster.GetManifest()->IsModified())
+    m_roster.GetManifest()->Save();
+}
+
+size_t GradingRosterTool::GetStudentCount() const
+{
+  return m_roster.GetCount();
+}
+
+size_t GradingRosterTool::GetUnconfirmedCount() const
+{
+  return m_unconfirmed;
+}
+
+const std::vector<std::string> &GradingRosterTool::GetErrors() const
+{
+  return m_errors;
+}
+
+bool GradingRosterTool::OnScan()
+{
+  return true;
+}
+
+void GradingRosterTool::OnRunStart(int threads)
+{
+}
+
+void GradingRosterTool::OnRunEnd()
+{
+}
+
+bool GradingRosterTool::NextStudent(size_t *index)
+{
+  wxMutexLocker lock(m_mutex);
+
+  if (m_next >= m_roster.GetCount())
+    return false;
+
+  *index = m_next++;
+  return true;
+}
+
+// Finds the student's grade file for the part and reads the .ss sheet that goes
+// with it, if they've been graded. A sheet the tests marked doesn't count as
+// graded until somebody's opened it and saved it, so it's left out and counted.
+GradingRosterTool::SheetStatus GradingRosterTool::ReadSheet(size_t index, GradingSheet *sheet, std::string *gradeFilename)
+{
+  const std::string &student = m_roster.GetStudent(index);
+  std::string dirname = m_roster.GetStudentPath(index);
+
+  sPartFiles files;
+  if (!m_roster.GetManifest()->GetPartFiles(dirname, m_part, &files))
+  {
+    AddError(student + ": couldn't open the student's directory");
+    return SHEET_FAILED;
+  }
+
+  if (files.gradeFilename.empty())
+  {
+    AddError(student + ": no grade file matching " + m_part.gradeFileFilter);
+    return SHEET_FAILED;
+  }
+
+  *gradeFilename = dirname + '/' + files.gradeFilename;
+  std::string scoreFilename = GradingSheet::ScoreFilename(*gradeFilename);
+  if (!wxFileExists(scoreFilename))
+    return SHEET_MISSING;
+
+  sParseError error;
+  if (!sheet->Load(scoreFilename, &error))
+  {
+    AddError(student + ": couldn't read " + scoreFilename + " (" + error.ToString() + ")");
+    return SHEET_FAILED;
+  }
+
+  if (sheet->GetCategories().size() == 0)
+  {
+    AddError(student + ": " + scoreFilename + " doesn't look like a score sheet");
+    return SHEET_FAILED;
+  }
+
+  if (!sheet->m_pending.empty())
+  {
+    wxMutexLocker lock(m_mutex);
+    m_unconfirmed++;
+    return SHEET_UNCONFIRMED;
+  }
+
+  return SHEET_READ;
+}
+
+void GradingRosterTool::AddError(std::string error)
+{
+  wxMutexLocker lock(m_mutex);
+  m_errors.push_back(error);
+}
+
+// The part can be given by name, or by its number in parts_conf.txt.
+bool GradingRosterTool::LoadPart(const char *name, sAssignmentPart *part)
+{
+  std::vector<sAssignmentPart> parts;
+  if (!LoadAssignmentParts("parts_conf.txt", &parts))
+  {
+    fprintf(stderr, "The assignment parts description file is malformed.\n");
+    return false;
+  }
+
+  int index = FindAssignmentPart(parts, name);
+  if (index < 0)
+  {
+    fprintf(stderr, "There's no assignment part called \"%s\" in parts_conf.txt.\n", name);
+    return false;
+  }
+
+  *part = parts[index];
+  return true;
+}
+
+bool GradingRosterTool::LoadTemplate(const char *filename, GradingSheet *tmpl)
+{
+  sParseError error;
+  if (!tmpl->Load(filename, &error) || tmpl->GetCategories().size() == 0)
+  {
+    fprintf(stderr, "The template %s doesn't look right (%s).\n", filename,
+      (tmpl->GetCategories().size() == 0)?"no categories":error.ToString().c_str());
+    return false;
+  }
+
+  return true;
+}
+
+void GradingRosterTool::PrintErrors() const
+{
+  for (size_t i = 0; i < m_errors.size(); i++)
+    fprintf(stderr, "%s\n", m_errors[i].c_str());
+}
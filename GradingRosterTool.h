@@ -0,0 +1,80 @@
+#ifndef GRADINGROSTERTOOL_H
+#define GRADINGROSTERTOOL_H
+
+#include <wx/thread.h>
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+#include "GradingRoster.h"
+
+// A roster tool does something to every student under a roster root without
+// opening any windows, like batch mode does. The roster root is the directory
+// holding all the student directories, the same one GraderFrame::m_root points
+// at. Scan reads the roster, and Run hands the students out by index to a pool
+// of worker threads, one per core by default, which call ProcessStudent for
+// each one. A tool that keeps a row per student doesn't have to lock them,
+// since each worker only ever touches the rows it was handed; counts and
+// errors do need locking, through m_mutex and AddError.
+
+class GradingRosterTool
+{
+  public:
+  GradingRosterTool(std::string root, const sAssignmentPart &part);
+  virtual ~GradingRosterTool();
+
+  bool Scan();
+  void Run(int threads = 0);
+
+  size_t GetStudentCount() const;
+  size_t GetUnconfirmedCount() const;
+  const std::vector<std::string> &GetErrors() const;
+
+  // What ReadSheet found.
+  enum SheetStatus {
+    SHEET_READ,
+    SHEET_MISSING,      // Nobody has graded them yet, which is fine.
+    SHEET_UNCONFIRMED,  // Only the tests have marked it (see GradingSheet::m_pending).
+    SHEET_FAILED        // Something went wrong, and it's been added to the errors.
+  };
+
+  // Helpers for the tools' Main functions. They complain on stderr themselves.
+  static bool LoadPart(const char *name, sAssignmentPart *part);
+  static bool LoadTemplate(const char *filename, GradingSheet *tmpl);
+  void PrintErrors() const;
+
+  protected:
+  class Worker: public wxThread
+  {
+    public:
+    Worker(GradingRosterTool *tool);
+
+    protected:
+    GradingRosterTool *m_tool;
+
+    ExitCode Entry();
+  };
+
+  std::string m_root;
+  GradingRoster m_roster;
+  sAssignmentPart m_part;
+
+  size_t m_next;
+  size_t m_unconfirmed;
+  std::vector<std::string> m_errors;
+  wxMutex m_mutex;
+
+  // Scan calls OnScan once the roster's been read, to set up the rows. Run
+  // calls OnRunStart before any workers are started and OnRunEnd after
+  // they've all finished, both on the calling thread.
+  virtual bool OnScan();
+  virtual void OnRunStart(int threads);
+  virtual void OnRunEnd();
+  virtual void ProcessStudent(size_t index) = 0;
+
+  bool NextStudent(size_t *index);
+  SheetStatus ReadSheet(size_t index, GradingSheet *sheet, std::string *gradeFilename);
+  void AddError(std::string error);
+};
+
+#endif
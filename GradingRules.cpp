@@ -0,0 +1,590 @@
+#include "GradingRules.h"
+
+#include <wx/stopwatch.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+// Past this many, another line that matches doesn't tell the grader anything new.
+const size_t GradingRuleMatcher::MAX_HITS = 10;
+
+//-----Rules-----
+
+static bool RuleFailed(const sTemplateExtra &extra, const char *message, sParseError *error)
+{
+  if (error != NULL)
+  {
+    error->line = extra.line;
+    error->column = extra.column;
+    error->message = message;
+  }
+
+  return false;
+}
+
+// Reads the rules out of a template, which has to have been parsed into tmpl
+// already (see LoadTestCases).
+bool LoadRules(std::string filename, const GradingRubric *tmpl, std::vector<sRule> *rules, sParseError *error)
+{
+  rules->clear();
+
+  std::vector<sTemplateExtra> extras;
+  if (!ReadTemplateExtras(filename, &extras, error))
+    return false;
+
+  // Every category's headers are read first, so its SIGCHECKs can go above
+  // its SIGs.
+  std::vector<std::vector<sJavaMethod> > signatures(tmpl->m_categories.size());
+  for (size_t i = 0; i < extras.size(); i++)
+  {
+    const sTemplateExtra &extra = extras[i];
+    if (extra.word != "SIG")
+      continue;
+
+    if (extra.category < 0 || (size_t)extra.category >= tmpl->m_categories.size())
+      return RuleFailed(extra, "method header isn't in a category", error);
+
+    sJavaMethod method;
+    if (!ParseJavaSignature(extra.text, &method))
+      return RuleFailed(extra, "expected a method header like \"String reverse(String s)\"", error);
+    signatures[extra.category].push_back(method);
+  }
+
+  for (size_t i = 0; i < extras.size(); i++)
+  {
+    const sTemplateExtra &extra = extras[i];
+
+    sRule rule;
+    rule.word = extra.word;
+    rule.present = (extra.word[0] == 'H');
+    rule.comments = (extra.word == "HASTEXT" || extra.word == "LACKSTEXT");
+    if (extra.word != "HAS" && extra.word != "LACKS" && !rule.comments && extra.word != "SIGCHECK")
+      continue;  // Somebody else's
+
+    const char *wrong = FindTemplateBox(*tmpl, extra, &rule.box, &rule.label);
+    if (wrong != NULL)
+      return RuleFailed(extra, ("rule " + std::string(wrong)).c_str(), error);
+
+    if (extra.word == "SIGCHECK")
+    {
+      if (extra.text != "missing" && extra.text != "name" && extra.text != "parameters" && extra.text != "return")
+        return RuleFailed(extra, "expected missing, name, parameters or return", error);
+      if (signatures[extra.category].size() == 0)
+        return RuleFailed(extra, "there's no SIG in this category to check against", error);
+      rule.signatures = signatures[extra.category];
+    }
+    else if (extra.text.empty())
+      return RuleFailed(extra, "expected the rule's pattern", error);
+    else if (!wxRegEx(extra.text.c_str(), wxRE_DEFAULT | wxRE_NEWLINE).IsValid())
+      return RuleFailed(extra, "the regular expression doesn't make sense", error);
+
+    rule.category = extra.category;
+    rule.deduction = extra.deduction;
+    rule.pattern = extra.text;
+
+    rules->push_back(rule);
+  }
+
+  return true;
+}
+
+// Blanks out comments and the insides of string and character literals, leaving
+// every line break where it was. Carriage returns go too, so $ still works on
+// files from Windows.
+static void BlankComments(const char *data, size_t length, std::string *code)
+{
+  enum {CODE, LINE_COMMENT, BLOCK_COMMENT, STRING, CHARACTER} state = CODE;
+
+  code->assign(data, length);
+  for (size_t i = 0; i < length; i++)
+  {
+    char &c = (*code)[i];
+    char next = (i + 1 < length)?data[i + 1]:'\0';
+
+    if (c == '\r')
+    {
+      c = ' ';
+      continue;
+    }
+
+    switch (state)
+    {
+    case CODE:
+      if (c == '/' && next == '/')
+      {
+        state = LINE_COMMENT;
+        c = ' ';
+      }
+      else if (c == '/' && next == '*')
+      {
+        state = BLOCK_COMMENT;
+        c = (*code)[++i] = ' ';
+      }
+      else if (c == '"')
+        state = STRING;
+      else if (c == '\'')
+        state = CHARACTER;
+      break;
+
+    case LINE_COMMENT:
+      if (c == '\n')
+        state = CODE;
+      else
+        c = ' ';
+      break;
+
+    case BLOCK_COMMENT:
+      if (c == '*' && next == '/')
+      {
+        state = CODE;
+        c = (*code)[++i] = ' ';
+      }
+      else if (c != '\n')
+        c = ' ';
+      break;
+
+    case STRING:
+    case CHARACTER:
+      // A literal that runs off the end of its line was a mistake, and
+      // shouldn't take the rest of the file with it.
+      if (c == '\\' && next != '\n' && next != '\0')
+        c = (*code)[++i] = ' ';
+      else if (c == '\n' || c == ((state == STRING)?'"':'\''))
+        state = CODE;
+      else
+        c = ' ';
+      break;
+    }
+  }
+}
+
+// How many letters it takes to turn one name into the other, ignoring case.
+static size_t NameDistance(const std::string &a, const std::string &b)
+{
+  std::vector<size_t> row(b.length() + 1), next(b.length() + 1);
+  for (size_t j = 0; j <= b.length(); j++)
+    row[j] = j;
+
+  for (size_t i = 0; i < a.length(); i++)
+  {
+    next[0] = i + 1;
+    for (size_t j = 0; j < b.length(); j++)
+    {
+      size_t change = row[j] + (tolower((unsigned char)a[i]) != tolower((unsigned char)b[j]));
+      next[j + 1] = std::min(change, std::min(row[j + 1], next[j]) + 1);
+    }
+    row.swap(next);
+  }
+
+  return row[b.length()];
+}
+
+//-----GradingRuleMatcher-----
+
+GradingRuleMatcher::GradingRuleMatcher(const std::vector<sRule> &rules, GradingOutlineCache *outlines):
+  m_rules(rules),
+  m_outlines(outlines)
+{
+  m_signatures = false;
+
+  for (size_t i = 0; i < m_rules.size(); i++)
+  {
+    if (m_rules[i].word == "SIGCHECK")
+    {
+      m_signatures = true;
+      for (size_t j = 0; j < m_rules[i].signatures.size(); j++)
+        m_expected.push_back(m_rules[i].signatures[j].name);
+
+      m_patterns.push_back(NULL);
+      continue;
+    }
+
+    wxRegEx *pattern = new wxRegEx(m_rules[i].pattern.c_str(), wxRE_DEFAULT | wxRE_NEWLINE);
+    if (!pattern->IsValid())
+    {
+      delete pattern;
+      pattern = NULL;
+    }
+    m_patterns.push_back(pattern);
+  }
+
+  Begin();
+}
+
+GradingRuleMatcher::~GradingRuleMatcher()
+{
+  for (size_t i = 0; i < m_patterns.size(); i++)
+    delete m_patterns[i];
+}
+
+void GradingRuleMatcher::Begin()
+{
+  m_matched.assign(m_rules.size(), false);
+  m_hits.assign(m_rules.size(), std::vector<sRuleHit>());
+  m_methods.clear();
+  m_methodFiles.clear();
+}
+
+// Java files are indexed for the SIGCHECKs. Then the file is blanked once, and
+// every pattern that still needs looking at gets a go at it.
+void GradingRuleMatcher::AddFile(std::string filename, const char *data, size_t length, unsigned int hash)
+{
+  if (m_signatures && IsJavaFile(filename))
+  {
+    sJavaOutline outline;
+    if (m_outlines)
+      m_outlines->Index(data, length, &outline, hash);
+    else
+      IndexJava(data, length, &outline);
+
+    for (size_t i = 0; i < outline.classes.size(); i++)
+    {
+      const std::vector<sJavaMethod> &methods = outline.classes[i].methods;
+      m_methods.insert(m_methods.end(), methods.begin(), methods.end());
+      m_methodFiles.insert(m_methodFiles.end(), methods.size(), filename);
+    }
+  }
+
+  std::vector<size_t> waiting;
+  for (size_t i = 0; i < m_rules.size(); i++)
+  {
+    if (m_patterns[i] != NULL && !(m_matched[i] && (!m_rules[i].present || m_hits[i].size() >= MAX_HITS)))
+      waiting.push_back(i);
+  }
+
+  if (waiting.size() == 0)
+    return;
+
+  std::string code, text(data, length);
+  std::replace(text.begin(), text.end(), '\r', ' ');
+  BlankComments(data, length, &code);
+
+  std::vector<size_t> newlines;
+  for (const char *pos = data, *end = data + length; (pos = (const char *)memchr(pos, '\n', end - pos)) != NULL; pos++)
+    newlines.push_back(pos - data);
+
+  for (size_t i = 0; i < waiting.size(); i++)
+    Match(waiting[i], filename, m_rules[waiting[i]].comments?text:code, newlines);
+}
+
+// Finds the lines the rule matches. Each line is only counted once, so after a
+// match the search picks up again at the start of the next line.
+void GradingRuleMatcher::Match(size_t rule, std::string filename, const std::string &text,
+  const std::vector<size_t> &newlines)
+{
+  wxRegEx *pattern = m_patterns[rule];
+  size_t offset = 0;
+
+  while (offset <= text.length() && pattern->Matches(text.c_str() + offset))
+  {
+    size_t start, length;
+    pattern->GetMatch(&start, &length);
+    start += offset;
+
+    m_matched[rule] = true;
+    if (!m_rules[rule].present || m_hits[rule].size() >= MAX_HITS)
+      return;
+
+    size_t line = std::lower_bound(newlines.begin(), newlines.end(), start) - newlines.begin();
+    sRuleHit hit = {filename, (int)line + 1};
+    m_hits[rule].push_back(hit);
+
+    if (line >= newlines.size())
+      return;
+    offset = newlines[line] + 1;
+  }
+}
+
+void GradingRuleMatcher::Finish(std::vector<sRuleSuggestion> *suggestions)
+{
+  suggestions->clear();
+
+  for (size_t i = 0; i < m_rules.size(); i++)
+  {
+    const sRule &rule = m_rules[i];
+
+    sRuleSuggestion suggestion;
+    suggestion.rule = i;
+    suggestion.category = rule.category;
+    suggestion.deduction = rule.deduction;
+    suggestion.box = rule.box;
+
+    if (rule.word == "SIGCHECK")
+    {
+      if (!CheckSignatures(rule, &suggestion))
+        continue;
+    }
+    else if (m_patterns[i] == NULL || m_matched[i] != rule.present)
+      continue;
+    else if (rule.present)
+    {
+      suggestion.reason = "matches " + rule.pattern + " on ";
+      for (size_t j = 0; j < m_hits[i].size(); j++)
+        suggestion.reason += wxString::Format("%s%s:%d", (j > 0)?", ":"", m_hits[i][j].filename.c_str(),
+          m_hits[i][j].line).c_str();
+      suggestion.hits.swap(m_hits[i]);
+    }
+    else
+      suggestion.reason = "nothing matches " + rule.pattern;
+
+    suggestions->push_back(suggestion);
+  }
+}
+
+// Works out which of the student's methods is meant to be the expected one (see
+// GradingRules.h). Constructors only ever stand in for constructors. Returns
+// -1 if nothing looks like it.
+int GradingRuleMatcher::FindMethod(const sJavaMethod &expected) const
+{
+  int best = -1, bestScore = 0;
+
+  for (size_t i = 0; i < m_methods.size(); i++)
+  {
+    const sJavaMethod &method = m_methods[i];
+    if (method.returnType.empty() != expected.returnType.empty())
+      continue;
+
+    bool sameParameters = (method.parameters == expected.parameters);
+    bool sameReturn = (method.returnType == expected.returnType);
+    bool otherExpected = std::find(m_expected.begin(), m_expected.end(), method.name) != m_expected.end();
+
+    // Longer names get a bit more room for typos.
+    int score;
+    if (method.name == expected.name)
+      score = 300;
+    else if (!otherExpected && NameDistance(method.name, expected.name) <= std::min((size_t)2, expected.name.length() / 4))
+      score = 200;
+    else if (!otherExpected && sameParameters && sameReturn && expected.parameters.size() > 0 && method.name != "main")
+      score = 100;
+    else
+      continue;
+
+    score += (sameParameters?2:0) + (sameReturn?1:0);
+    if (score > bestScore)
+    {
+      best = i;
+      bestScore = score;
+    }
+  }
+
+  return best;
+}
+
+// Checks every header the rule's category expects. Returns whether anything
+// was wrong with any of them.
+bool GradingRuleMatcher::CheckSignatures(const sRule &rule, sRuleSuggestion *suggestion) const
+{
+  for (size_t i = 0; i < rule.signatures.size(); i++)
+  {
+    const sJavaMethod &expected = rule.signatures[i];
+    int found = FindMethod(expected);
+    std::string problem;
+
+    if (found < 0)
+    {
+      if (rule.pattern == "missing")
+        problem = "nothing like " + expected.ToString();
+    }
+    else
+    {
+      const sJavaMethod &method = m_methods[found];
+      std::string where = wxString::Format(" on %s:%d", m_methodFiles[found].c_str(), method.line).c_str();
+
+      if (rule.pattern == "name" && method.name != expected.name)
+        problem = method.name + where + " instead of " + expected.name;
+      else if (rule.pattern == "parameters" && method.parameters != expected.parameters)
+        problem = method.name + method.GetParameterList() + where + " instead of " + expected.GetParameterList();
+      else if (rule.pattern == "return" && method.returnType != expected.returnType)
+        problem = method.name + " returns " + method.returnType + where + " instead of " + expected.returnType;
+
+      if (!problem.empty())
+      {
+        sRuleHit hit = {m_methodFiles[found], method.line};
+        suggestion->hits.push_back(hit);
+      }
+    }
+
+    if (!problem.empty())
+      suggestion->reason += (suggestion->reason.empty()?"":"; ") + problem;
+  }
+
+  return !suggestion->reason.empty();
+}
+
+//-----GradingRules-----
+
+GradingRules::GradingRules(std::string root, const sAssignmentPart &part, const std::vector<sRule> &rules):
+  GradingRosterTool(root, part),
+  m_rules(rules)
+{
+}
+
+GradingRules::~GradingRules()
+{
+  for (size_t i = 0; i < m_matchers.size(); i++)
+    delete m_matchers[i];
+}
+
+const std::vector<sRuleRow> &GradingRules::GetRows() const
+{
+  return m_rows;
+}
+
+bool GradingRules::OnScan()
+{
+  m_rows.clear();
+  m_rows.resize(m_roster.GetCount());
+  for (size_t i = 0; i < m_rows.size(); i++)
+  {
+    m_rows[i].student = m_roster.GetStudent(i);
+    m_rows[i].checked = false;
+  }
+
+  return true;
+}
+
+// Compiling the rules costs more than checking a student with them, so the
+// matchers are handed back and reused. There's never more of them than
+// there are workers.
+GradingRuleMatcher *GradingRules::TakeMatcher()
+{
+  {
+    wxMutexLocker lock(m_mutex);
+    if (m_matchers.size() > 0)
+    {
+      GradingRuleMatcher *matcher = m_matchers.back();
+      m_matchers.pop_back();
+      return matcher;
+    }
+  }
+
+  return new GradingRuleMatcher(m_rules, &m_outlines);
+}
+
+void GradingRules::ReturnMatcher(GradingRuleMatcher *matcher)
+{
+  wxMutexLocker lock(m_mutex);
+  m_matchers.push_back(matcher);
+}
+
+void GradingRules::ProcessStudent(size_t index)
+{
+  sRuleRow &row = m_rows[index];
+  std::string dirname = m_roster.GetStudentPath(index);
+
+  sPartFiles files;
+  if (!m_roster.GetManifest()->GetPartFiles(dirname, m_part, &files))
+  {
+    AddError(row.student + ": couldn't open the student's directory");
+    return;
+  }
+
+  if (files.submissions.size() == 0)
+    return;
+
+  GradingRuleMatcher *matcher = TakeMatcher();
+  matcher->Begin();
+  for (size_t i = 0; i < files.submissions.size(); i++)
+  {
+    GradingFileView view;
+    if (!view.Open(dirname + '/' + files.submissions[i]))
+    {
+      AddError(row.student + ": couldn't read " + files.submissions[i]);
+      continue;
+    }
+
+    unsigned int hash;
+    unsigned long size;
+    if (!m_roster.GetManifest()->GetFileHash(dirname, files.submissions[i], &hash, &size) || size != view.GetLength())
+      hash = 0;
+
+    matcher->AddFile(files.submissions[i], view.GetData(), view.GetLength(), hash);
+  }
+
+  matcher->Finish(&row.suggestions);
+  ReturnMatcher(matcher);
+  row.checked = true;
+}
+
+int GradingRules::Main(int argc, char **argv)
+{
+  if (argc != 5 || std::string(argv[1]) != "--rules")
+  {
+    fprintf(stderr, "usage: %s --rules <part> <roster root> <template>\n", argv[0]);
+    return 2;
+  }
+
+  sAssignmentPart part;
+  GradingSheet tmpl;
+  if (!LoadPart(argv[2], &part) || !LoadTemplate(argv[4], &tmpl))
+    return 1;
+
+  sParseError error;
+  std::vector<sRule> rules;
+  if (!LoadRules(argv[4], tmpl.GetRubric(), &rules, &error))
+  {
+    fprintf(stderr, "The rules in %s don't look right (%s).\n", argv[4], error.ToString().c_str());
+    return 1;
+  }
+
+  if (rules.size() == 0)
+  {
+    fprintf(stderr, "The template %s doesn't have any rules in it.\n", argv[4]);
+    return 1;
+  }
+
+  // The time includes reading everyone's files, since that's most of it.
+  wxStopWatch watch;
+
+  GradingRules checker(argv[3], part, rules);
+  if (!checker.Scan())
+  {
+    fprintf(stderr, "I couldn't open the roster directory %s.\n", argv[3]);
+    return 1;
+  }
+
+  checker.Run();
+  long milliseconds = watch.Time();
+
+  // Everyone something was suggested for, and why.
+  const std::vector<sRuleRow> &rows = checker.GetRows();
+  std::vector<size_t> counts(rules.size(), 0);
+  size_t checked = 0;
+  for (size_t i = 0; i < rows.size(); i++)
+  {
+    if (!rows[i].checked)
+      continue;
+
+    checked++;
+    if (rows[i].suggestions.size() == 0)
+      continue;
+
+    printf("%s:\n", rows[i].student.c_str());
+    for (size_t j = 0; j < rows[i].suggestions.size(); j++)
+    {
+      const sRuleSuggestion &suggestion = rows[i].suggestions[j];
+      printf("  %s: %s\n", rules[suggestion.rule].label.c_str(), suggestion.reason.c_str());
+      counts[suggestion.rule]++;
+    }
+  }
+
+  // How often each rule went off, so the ones that go off for everybody (or
+  // nobody) stand out.
+  if (checked > 0)
+    printf("Rules:\n");
+  for (size_t i = 0; checked > 0 && i < rules.size(); i++)
+  {
+    printf("  %s %s (%s): %u of %u students\n", rules[i].word.c_str(), rules[i].pattern.c_str(), rules[i].label.c_str(),
+      (unsigned int)counts[i], (unsigned int)checked);
+  }
+
+  checker.PrintErrors();
+  const std::vector<std::string> &errors = checker.GetErrors();
+
+  printf("Checked %u of %u students against %u rules in %ld ms (%u errors).\n",
+    (unsigned int)checked, (unsigned int)checker.GetStudentCount(), (unsigned int)rules.size(), milliseconds,
+    (unsigned int)errors.size());
+
+  return errors.size() > 0;
+}
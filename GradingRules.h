@@ -0,0 +1,168 @@
+#ifndef GRADINGRULES_H
+#define GRADINGRULES_H
+
+#include <wx/regex.h>
+#include <wx/thread.h>
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+#include "GradingOutline.h"
+#include "GradingRosterTool.h"
+
+// A template can attach rules to any box that can be checked by itself, the
+// same way it attaches tests (see GradingTests). A rule is a regular expression
+// run over every submission, and a box with a rule that goes off is suggested
+// to the grader, never checked for them:
+//
+//   	DED [O] [-1] Scanner object is not created on the first line of main:
+//   		LACKS main\([^)]*\)[[:space:]]*\{[[:space:]]*Scanner
+//   	DED [O] [-2] prints result instead of returning it
+//   		HAS System\.out\.print.*(reverse|result)
+//
+//   HAS pattern        - Suggests the box if anything matches the pattern.
+//   LACKS pattern      - Suggests the box if nothing does.
+//   HASTEXT pattern    - Like HAS and LACKS, but the pattern also sees the
+//   LACKSTEXT pattern    comments, e.g. for deductions about commenting.
+//
+// HAS and LACKS look at the code with its comments and the insides of its
+// strings blanked out, so commented-out code and string literals that happen to
+// look like code don't set them off. That gets most of the way to matching
+// tokens instead of text, without having to parse anything. Patterns are
+// extended regular expressions where ^, $ and . stop at line breaks, but
+// [[:space:]] doesn't, so a pattern can still span lines. Lines keep their
+// numbers either way, so the lines that matched can be pointed at. Several
+// rules on one box suggest it if any of them go off.
+//
+// Rules can also check method headers against what the assignment asked for.
+// A category lists the headers it expects in SIG lines, anywhere in the
+// category, and SIGCHECK rules under its boxes say what to check them for:
+//
+//   CAT [5] 5 points for part a (printEveryOther)
+//   	SIG public static void printEveryOther(String s)
+//   	DED [O] [-5] missing
+//   		SIGCHECK missing
+//   	DED [O] [-1, -2, -3] method header problems:
+//   		CRT [O] incorrect method name
+//   			SIGCHECK name
+//   		CRT [O] incorrect parameter list
+//   			SIGCHECK parameters
+//   		CRT [O] incorrect return type
+//   			SIGCHECK return
+//
+// Each expected header is matched up with a method from the outlines of the
+// student's Java files (see GradingOutline): one with the same name, or failing
+// that, one whose name is off by a letter or two or by case, or failing that,
+// one that has the same parameters and return type and isn't named like any
+// other header the template expects. "missing" goes off if there's no such
+// method, and the others if there is one but its name, parameter types or
+// return type are wrong. Modifiers and parameter names aren't checked.
+
+struct sRule
+{
+  int category;
+  int deduction;
+  int box;             // Within the deduction.
+  std::string label;   // The box's, for reports.
+  std::string word;    // The kind of rule, as the template has it.
+  std::string pattern; // For SIGCHECK, what it checks.
+  bool present;        // HAS: whether a match sets it off, rather than the lack of one.
+  bool comments;       // HASTEXT or LACKSTEXT: whether it sees the comments too.
+  std::vector<sJavaMethod> signatures;  // SIGCHECK: its category's SIG lines.
+};
+
+bool LoadRules(std::string filename, const GradingRubric *tmpl, std::vector<sRule> *rules, sParseError *error = NULL);
+
+struct sRuleHit
+{
+  std::string filename;  // Just the name, not the directory.
+  int line;              // Starting at 1.
+};
+
+// A rule that went off for one student.
+struct sRuleSuggestion
+{
+  size_t rule;
+  int category;
+  int deduction;
+  int box;
+  std::string reason;
+  std::vector<sRuleHit> hits;  // Where HAS matched, or the methods SIGCHECK looked at.
+};
+
+// The matcher compiles every rule once and then checks one student's files at
+// a time: Begin, AddFile for each submission, and Finish for what went off.
+// Compiled expressions can't be shared between threads, so every thread that
+// checks students needs its own matcher. They can share an outline cache,
+// though; without one, every Java file is indexed from scratch.
+
+class GradingRuleMatcher
+{
+  public:
+  GradingRuleMatcher(const std::vector<sRule> &rules, GradingOutlineCache *outlines = NULL);
+  ~GradingRuleMatcher();
+
+  void Begin();
+  void AddFile(std::string filename, const char *data, size_t length, unsigned int hash = 0);
+  void Finish(std::vector<sRuleSuggestion> *suggestions);
+
+  static const size_t MAX_HITS;
+
+  protected:
+  std::vector<sRule> m_rules;
+  std::vector<wxRegEx *> m_patterns;  // NULL for SIGCHECK, or if the pattern didn't compile.
+  std::vector<bool> m_matched;
+  std::vector<std::vector<sRuleHit> > m_hits;
+
+  GradingOutlineCache *m_outlines;
+  bool m_signatures;                     // Whether there are any SIGCHECK rules.
+  std::vector<std::string> m_expected;   // The name of every SIG in the template.
+  std::vector<sJavaMethod> m_methods;    // Everything in the student's Java files so far,
+  std::vector<std::string> m_methodFiles;  // and which file each one is in.
+
+  void Match(size_t rule, std::string filename, const std::string &text, const std::vector<size_t> &newlines);
+  int FindMethod(const sJavaMethod &expected) const;
+  bool CheckSignatures(const sRule &rule, sRuleSuggestion *suggestion) const;
+
+  private:
+  GradingRuleMatcher(const GradingRuleMatcher &);
+  GradingRuleMatcher &operator=(const GradingRuleMatcher &);
+};
+
+// The rule checker runs every rule over a whole roster on a pool of worker
+// threads (see GradingRosterTool), and just reports what it would suggest.
+// Nothing is written, so rules can be tried out and tweaked as often as it
+// takes to get them right.
+
+struct sRuleRow
+{
+  std::string student;
+  bool checked;   // False if they had nothing to check.
+  std::vector<sRuleSuggestion> suggestions;
+};
+
+class GradingRules: public GradingRosterTool
+{
+  public:
+  GradingRules(std::string root, const sAssignmentPart &part, const std::vector<sRule> &rules);
+  ~GradingRules();
+
+  const std::vector<sRuleRow> &GetRows() const;
+
+  // Command line entry point: grader --rules <part> <roster root> <template>
+  static int Main(int argc, char **argv);
+
+  protected:
+  std::vector<sRule> m_rules;
+  GradingOutlineCache m_outlines;
+  std::vector<GradingRuleMatcher *> m_matchers;  // Compiled, and not in use right now.
+
+  std::vector<sRuleRow> m_rows;
+
+  bool OnScan();
+  void ProcessStudent(size_t index);
+  GradingRuleMatcher *TakeMatcher();
+  void ReturnMatcher(GradingRuleMatcher *matcher);
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "GradingScheduler.h"
+
+#include <wx/wx.h>
+#include <wx/stopwatch.h>
+
+//-----GradingTask-----
+
+GradingTask::~GradingTask()
+{
+}
+
+//-----GradingScheduler-----
+
+GradingScheduler::GradingScheduler()
+{
+  m_order = 0;
+}
+
+GradingScheduler::~GradingScheduler()
+{
+  Clear();
+}
+
+// Takes ownership of the task, and deletes it once it's done. If the program
+// was asleep, this wakes it up to start on it.
+void GradingScheduler::Add(GradingTask *task, int priority, long budget)
+{
+  sTask t = {task, priority, budget, m_order++};
+  m_tasks.push_back(t);
+
+  wxWakeUpIdle();
+}
+
+// Runs one slice of work. Returns true if there's still something waiting.
+bool GradingScheduler::Run()
+{
+  if (m_tasks.empty())
+    return false;
+
+  size_t next = 0;
+  for (size_t i = 1; i < m_tasks.size(); i++)
+  {
+    if (m_tasks[i].priority > m_tasks[next].priority ||
+        (m_tasks[i].priority == m_tasks[next].priority && m_tasks[i].order < m_tasks[next].order))
+      next = i;
+  }
+
+  GradingTask *task = m_tasks[next].task;
+  long budget = m_tasks[next].budget;
+
+  wxStopWatch watch;
+  bool more;
+  do
+    more = task->Step();
+  while (more && watch.Time() < budget);
+
+  // Steps can add tasks of their own, so the task is looked up again rather
+  // than trusting the index.
+  if (!more)
+  {
+    for (size_t i = 0; i < m_tasks.size(); i++)
+    {
+      if (m_tasks[i].task == task)
+      {
+        m_tasks.erase(m_tasks.begin() + i);
+        break;
+      }
+    }
+    delete task;
+  }
+
+  return !m_tasks.empty();
+}
+
+bool GradingScheduler::IsEmpty() const
+{
+  return m_tasks.empty();
+}
+
+void GradingScheduler::Clear()
+{
+  for (size_t i = 0; i < m_tasks.size(); i++)
+    delete m_tasks[i].task;
+
+  m_tasks.clear();
+}
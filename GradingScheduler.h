@@ -0,0 +1,58 @@
+#ifndef GRADINGSCHEDULER_H
+#define GRADINGSCHEDULER_H
+
+#include <vector>
+
+// A task is a piece of work that can be done a little at a time on the UI
+// thread, whenever there's nothing better to do. Step does one small piece and
+// returns true if there's more left.
+
+class GradingTask
+{
+  public:
+  virtual ~GradingTask();
+
+  virtual bool Step() = 0;
+};
+
+// The scheduler runs tasks from the frame's idle handler. Each idle event gets
+// one slice: the highest priority task (oldest first, between equals) steps
+// until it's done or its time budget in milliseconds runs out. The frame only
+// asks for more idle events while there are tasks waiting, so when there's
+// nothing to do the program sleeps until the next real event.
+
+class GradingScheduler
+{
+  public:
+  enum {
+    PRIORITY_LOW = 0,
+    PRIORITY_NORMAL = 50,
+    PRIORITY_HIGH = 100
+  };
+
+  GradingScheduler();
+  ~GradingScheduler();
+
+  void Add(GradingTask *task, int priority = PRIORITY_NORMAL, long budget = 10);
+  bool Run();
+  bool IsEmpty() const;
+  void Clear();
+
+  protected:
+  struct sTask
+  {
+    GradingTask *task;
+    int priority;
+    long budget;
+    unsigned int order;
+  };
+
+  std::vector<sTask> m_tasks;
+  unsigned int m_order;
+
+  private:
+  GradingScheduler(const GradingScheduler &);
+  GradingScheduler &operator=(const GradingScheduler &);
+};
+
+#endif
@@ -0,0 +1,310 @@
+#include "GradingScores.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//-----GradingScoreMatrix-----
+
+// Two rubrics have the same layout if every box is in the same place and means
+// the same thing, whatever it's worth.
+static bool HasSameLayout(const GradingRubric &a, const GradingRubric &b)
+{
+  if (a.m_categories.size() != b.m_categories.size())
+    return false;
+
+  for (size_t i = 0; i < a.m_categories.size(); i++)
+  {
+    const GradingCategory &x = a.m_categories[i], &y = b.m_categories[i];
+    if (x.m_label != y.m_label || x.m_dedux.size() != y.m_dedux.size())
+      return false;
+
+    for (size_t j = 0; j < x.m_dedux.size(); j++)
+      if (x.m_dedux[j].m_label != y.m_dedux[j].m_label || x.m_dedux[j].m_choices != y.m_dedux[j].m_choices)
+        return false;
+  }
+
+  return true;
+}
+
+GradingScoreMatrix::GradingScoreMatrix()
+{
+  m_rubric = NULL;
+  m_maxPoints = 0.0f;
+  m_students = 0;
+}
+
+// Starts the matrix over on the given rubric, which has to outlive it, with no
+// students in it.
+bool GradingScoreMatrix::SetRubric(const GradingRubric *rubric)
+{
+  m_rubric = NULL;
+  m_firstDeduction.clear();
+  m_values.clear();
+  m_maxPoints = 0.0f;
+  m_tableStart.clear();
+  m_tableLast.clear();
+  m_tables.clear();
+  Clear();
+
+  if (rubric == NULL)
+    return false;
+
+  const std::vector<GradingCategory> &categories = rubric->m_categories;
+  size_t deductions = 0;
+  for (size_t i = 0; i < categories.size(); i++)
+  {
+    m_firstDeduction.push_back(deductions);
+    deductions += categories[i].m_dedux.size();
+
+    for (size_t j = 0; j < categories[i].m_dedux.size(); j++)
+      if (categories[i].m_dedux[j].m_mapping.size() > 255)
+        return false;
+  }
+  m_firstDeduction.push_back(deductions);
+
+  m_rubric = rubric;
+  m_maxPoints = rubric->m_maxPoints;
+  for (size_t i = 0; i < categories.size(); i++)
+    m_values.push_back(categories[i].m_value);
+
+  m_tableStart.resize(deductions);
+  m_tableLast.resize(deductions);
+
+  for (size_t i = 0; i < categories.size(); i++)
+  {
+    for (size_t j = 0; j < categories[i].m_dedux.size(); j++)
+    {
+      size_t d = m_firstDeduction[i] + j;
+      m_tableStart[d] = m_tables.size();
+      m_tableLast[d] = categories[i].m_dedux[j].m_mapping.size();
+      m_tables.resize(m_tables.size() + m_tableLast[d] + 1);
+
+      BuildTable(d, categories[i].m_dedux[j].m_mapping);
+    }
+  }
+
+  return true;
+}
+
+const GradingRubric *GradingScoreMatrix::GetRubric() const
+{
+  return m_rubric;
+}
+
+// Takes out every student, but keeps the rubric and any values that were set.
+void GradingScoreMatrix::Clear()
+{
+  m_counts.clear();
+  m_totals.clear();
+  m_categoryPoints.clear();
+  m_students = 0;
+}
+
+// Adds a student at the end. Their sheet has to have the same layout as the
+// matrix's rubric.
+bool GradingScoreMatrix::AddStudent(const GradingSheet &sheet)
+{
+  if (m_rubric == NULL || !HasSameLayout(*m_rubric, *sheet.GetRubric()))
+    return false;
+
+  if (m_students % BLOCK == 0)
+    m_counts.resize(m_counts.size() + GetDeductionCount() * BLOCK, 0);
+
+  const std::vector<GradingCategory> &categories = sheet.GetCategories();
+  for (size_t i = 0; i < categories.size(); i++)
+    for (size_t j = 0; j < categories[i].m_dedux.size(); j++)
+      SetCount(m_students, m_firstDeduction[i] + j, categories[i].m_dedux[j].CountApplied(sheet.m_applied));
+
+  m_students++;
+  return true;
+}
+
+void GradingScoreMatrix::SetCount(size_t student, size_t deduction, int count)
+{
+  Count(student, deduction) = (count > 255)?255:count;
+}
+
+int GradingScoreMatrix::GetCount(size_t student, size_t deduction) const
+{
+  return m_counts[(student / BLOCK * GetDeductionCount() + deduction) * BLOCK + student % BLOCK];
+}
+
+// Gives a deduction a different mapping from the one in the rubric. Nothing is
+// rescored until the next call to Score.
+bool GradingScoreMatrix::SetMapping(size_t deduction, const std::vector<float> &mapping)
+{
+  if (mapping.size() > 255)
+    return false;
+
+  // The tables are packed together, so a different length means moving the
+  // rest of them.
+  if (mapping.size() != m_tableLast[deduction])
+  {
+    std::vector<float> tables;
+    for (size_t i = 0; i < m_tableStart.size(); i++)
+    {
+      size_t start = tables.size();
+      if (i == deduction)
+      {
+        m_tableLast[i] = mapping.size();
+        tables.resize(start + m_tableLast[i] + 1);
+      }
+      else
+        tables.insert(tables.end(), m_tables.begin() + m_tableStart[i], m_tables.begin() + m_tableStart[i] + m_tableLast[i] + 1);
+      m_tableStart[i] = start;
+    }
+
+    m_tables.swap(tables);
+  }
+
+  BuildTable(deduction, mapping);
+  return true;
+}
+
+// Changes what a category is worth, and with it the maximum, which is added up
+// the same way GradingRubric::Compile does it.
+void GradingScoreMatrix::SetCategoryValue(size_t category, float value)
+{
+  m_values[category] = value;
+
+  m_maxPoints = 0;
+  for (size_t i = 0; i + 1 < m_values.size(); i++)
+    m_maxPoints += m_values[i];
+}
+
+// Fills in a deduction's table, which already has to be the mapping's length.
+void GradingScoreMatrix::BuildTable(size_t deduction, const std::vector<float> &mapping)
+{
+  // No boxes is worth nothing, the same as GradingDeduction::GetValue.
+  float *table = &m_tables[m_tableStart[deduction]];
+  table[0] = 0.0f;
+  for (size_t i = 0; i < mapping.size(); i++)
+    table[i + 1] = mapping[i];
+}
+
+unsigned char &GradingScoreMatrix::Count(size_t student, size_t deduction)
+{
+  return m_counts[(student / BLOCK * GetDeductionCount() + deduction) * BLOCK + student % BLOCK];
+}
+
+// Works out every student's total and category points from their counts.
+void GradingScoreMatrix::Score()
+{
+  if (m_rubric == NULL)
+    return;
+
+  size_t blocks = (m_students + BLOCK - 1) / BLOCK;
+  m_totals.resize(blocks * BLOCK);
+  m_categoryPoints.resize(blocks * BLOCK * m_rubric->m_categories.size());
+
+  for (size_t i = 0; i < blocks; i++)
+    ScoreBlock(i);
+}
+
+size_t GradingScoreMatrix::GetStudentCount() const
+{
+  return m_students;
+}
+
+size_t GradingScoreMatrix::GetDeductionCount() const
+{
+  return m_tableStart.size();
+}
+
+size_t GradingScoreMatrix::GetDeduction(size_t category, size_t deduction) const
+{
+  return m_firstDeduction[category] + deduction;
+}
+
+float GradingScoreMatrix::GetMaxPoints() const
+{
+  return m_maxPoints;
+}
+
+float GradingScoreMatrix::GetTotal(size_t student) const
+{
+  return m_totals[student];
+}
+
+float GradingScoreMatrix::GetCategoryPoints(size_t student, size_t category) const
+{
+  return m_categoryPoints[(student / BLOCK * m_rubric->m_categories.size() + category) * BLOCK + student % BLOCK];
+}
+
+// Scores one block of students. Students past the end of the roster just have
+// nothing applied, and nobody looks at what they come out to.
+void GradingScoreMatrix::ScoreBlock(size_t block)
+{
+  const std::vector<GradingCategory> &categories = m_rubric->m_categories;
+  const unsigned char *counts = &m_counts[block * GetDeductionCount() * BLOCK];
+  float *points = &m_categoryPoints[block * categories.size() * BLOCK];
+  float *totals = &m_totals[block * BLOCK];
+
+#ifdef __SSE2__
+  // Each lane is one student. A lane's value is picked out of the table by
+  // comparing its count against every entry, and only one entry can match, so
+  // no arithmetic happens before the adds; those are the same ones, in the
+  // same order, as the plain version below.
+  __m128i zero = _mm_setzero_si128();
+  __m128 total = _mm_set1_ps(m_maxPoints);
+
+  for (size_t i = 0; i < categories.size(); i++)
+  {
+    __m128 category = _mm_set1_ps(m_values[i]);
+
+    for (size_t d = m_firstDeduction[i]; d < m_firstDeduction[i + 1]; d++)
+    {
+      const float *table = &m_tables[m_tableStart[d]];
+      int last = m_tableLast[d];
+
+      int packed;
+      memcpy(&packed, counts + d * BLOCK, sizeof(packed));
+      __m128i count = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+      count = _mm_min_epi16(count, _mm_set1_epi16(last));
+      count = _mm_unpacklo_epi16(count, zero);
+
+      __m128 value = _mm_setzero_ps();
+      for (int c = 1; c <= last; c++)
+      {
+        __m128 match = _mm_castsi128_ps(_mm_cmpeq_epi32(count, _mm_set1_epi32(c)));
+        value = _mm_or_ps(value, _mm_and_ps(match, _mm_set1_ps(table[c])));
+      }
+
+      total = _mm_add_ps(total, value);
+      category = _mm_add_ps(category, value);
+    }
+
+    _mm_storeu_ps(points + i * BLOCK, category);
+  }
+
+  _mm_storeu_ps(totals, total);
+#else
+  for (size_t lane = 0; lane < BLOCK; lane++)
+  {
+    float total = m_maxPoints;
+
+    for (size_t i = 0; i < categories.size(); i++)
+    {
+      float category = m_values[i];
+
+      for (size_t d = m_firstDeduction[i]; d < m_firstDeduction[i + 1]; d++)
+      {
+        int count = counts[d * BLOCK + lane];
+        if (count > m_tableLast[d])
+          count = m_tableLast[d];
+
+        float value = m_tables[m_tableStart[d] + count];
+        total += value;
+        category += value;
+      }
+
+      points[i * BLOCK + lane] = category;
+    }
+
+    totals[lane] = total;
+  }
+#endif
+}
@@ -0,0 +1,83 @@
+#ifndef GRADINGSCORES_H
+#define GRADINGSCORES_H
+
+#include "GradingCore.h"
+
+// The score matrix holds a whole roster's grading against one rubric: for every
+// student and every deduction, how many of that deduction's boxes are applied.
+// Score works out every student's total and category points in one pass, using
+// each deduction's mapping as a lookup table. The what-if dialog (see
+// GradingWhatIf) loads the roster into one once and rescores it on every
+// change to the point values, without going back through every sheet. The
+// regrade doesn't use it; it rewrites each sheet anyway, and TakeValues works
+// out the new totals as it goes.
+//
+// Students only have to be graded with the same categories, deductions and
+// criteria as the rubric; the point values all come from the rubric, or from
+// whatever they've been changed to since.
+//
+// Every total is added up in the same order GradingSheet::UpdateTotal does it
+// (the maximum, then each deduction in turn), so they come out exactly the
+// same. Where the compiler targets SSE2, four students are scored at a time.
+//
+// Deductions are numbered across the whole rubric, in the order the rubric
+// lists them. Counts are kept in a byte each, so a rubric with a mapping more
+// than 255 steps long can't be used.
+
+class GradingScoreMatrix
+{
+  public:
+  GradingScoreMatrix();
+
+  bool SetRubric(const GradingRubric *rubric);
+  const GradingRubric *GetRubric() const;
+  void Clear();
+
+  bool AddStudent(const GradingSheet &sheet);
+  void SetCount(size_t student, size_t deduction, int count);
+  int GetCount(size_t student, size_t deduction) const;
+
+  bool SetMapping(size_t deduction, const std::vector<float> &mapping);
+  void SetCategoryValue(size_t category, float value);
+
+  void Score();
+
+  size_t GetStudentCount() const;
+  size_t GetDeductionCount() const;
+  size_t GetDeduction(size_t category, size_t deduction) const;
+  float GetMaxPoints() const;
+  float GetTotal(size_t student) const;
+  float GetCategoryPoints(size_t student, size_t category) const;
+
+  protected:
+  enum { BLOCK = 4 };  // Students scored together.
+
+  const GradingRubric *m_rubric;
+
+  std::vector<size_t> m_firstDeduction;  // Per category.
+  std::vector<float> m_values;           // What each category is worth.
+  float m_maxPoints;
+
+  // Each deduction's value for 0, 1, 2... boxes applied, one table after
+  // another. Counts are capped at the end of their table, since every count
+  // past the end of the mapping is worth the same.
+  std::vector<float> m_tables;
+  std::vector<size_t> m_tableStart;
+  std::vector<unsigned char> m_tableLast;
+
+  // Students are kept in blocks: a block's counts for the first deduction,
+  // then its counts for the second, and so on. A pass over one block then reads
+  // straight through memory.
+  std::vector<unsigned char> m_counts;
+  size_t m_students;
+
+  std::vector<float> m_totals;
+  std::vector<float> m_categoryPoints;  // In blocks, like the counts.
+
+  void BuildTable(size_t deduction, const std::vector<float> &mapping);
+  unsigned char &Count(size_t student, size_t deduction);
+
+  void ScoreBlock(size_t block);
+};
+
+#endif
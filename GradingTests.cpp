@@ -0,0 +1,478 @@
+#include "GradingTests.h"
+#include "GradingCompile.h"
+
+#include <wx/filefn.h>
+#include <wx/regex.h>
+#include <wx/stdpaths.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+static const int DEFAULT_SECONDS = 10;
+static const int COMPILE_SECONDS = 120;
+
+//-----Test cases-----
+
+static bool TestFailed(const sTemplateExtra &extra, const char *message, sParseError *error)
+{
+  if (error != NULL)
+  {
+    error->line = extra.line;
+    error->column = extra.column;
+    error->message = message;
+  }
+
+  return false;
+}
+
+// Reads the tests out of a template. The boxes are counted the same way
+// GradingSheet::Parse counts them, so the template has to have been parsed
+// into tmpl already.
+bool LoadTestCases(std::string filename, const GradingRubric *tmpl, std::vector<sTestCase> *tests, sParseError *error)
+{
+  tests->clear();
+
+  std::vector<sTemplateExtra> extras;
+  if (!ReadTemplateExtras(filename, &extras, error))
+    return false;
+
+  sTestCase *test = NULL;
+  for (size_t i = 0; i < extras.size(); i++)
+  {
+    const sTemplateExtra &extra = extras[i];
+
+    // A test's lines all come right after it, under the same box.
+    if (i > 0 && (extra.category != extras[i - 1].category || extra.deduction != extras[i - 1].deduction ||
+      extra.criterion != extras[i - 1].criterion))
+      test = NULL;
+
+    if (extra.word == "TST")
+    {
+      sTestCase t;
+      const char *wrong = FindTemplateBox(*tmpl, extra, &t.box, &t.label);
+      if (wrong != NULL)
+        return TestFailed(extra, ("test " + std::string(wrong)).c_str(), error);
+
+      if (extra.text.empty())
+        return TestFailed(extra, "expected the test's command", error);
+
+      t.category = extra.category;
+      t.deduction = extra.deduction;
+      t.command = extra.text;
+      t.checkOutput = false;
+      t.seconds = DEFAULT_SECONDS;
+      t.megabytes = 0;
+
+      tests->push_back(t);
+      test = &tests->back();
+    }
+    else if (extra.word != "IN" && extra.word != "OUT" && extra.word != "RGX" && extra.word != "LIM")
+      test = NULL;  // Somebody else's
+    else if (test == NULL)
+      return TestFailed(extra, "expected TST", error);
+    else if (extra.word == "IN")
+      test->input += extra.text + '\n';
+    else if (extra.word == "OUT")
+    {
+      test->expected += extra.text + '\n';
+      test->checkOutput = true;
+    }
+    else if (extra.word == "RGX")
+    {
+      if (!wxRegEx(extra.text.c_str(), wxRE_DEFAULT | wxRE_NEWLINE).IsValid())
+        return TestFailed(extra, "the regular expression doesn't make sense", error);
+      test->pattern = extra.text;
+    }
+    else
+    {
+      char *after;
+      long seconds = strtol(extra.text.c_str(), &after, 10);
+      long megabytes = strtol(after, &after, 10);
+      if (after == extra.text.c_str() || seconds < 0 || megabytes < 0)
+        return TestFailed(extra, "expected the test's seconds and megabytes", error);
+
+      test->seconds = seconds;
+      test->megabytes = megabytes;
+    }
+  }
+
+  return true;
+}
+
+// Output is compared without '\r's, spaces at the ends of lines or blank lines
+// at the end, which nobody can see anyway.
+static std::string NormalizeOutput(const std::string &output)
+{
+  std::string normal;
+  size_t start = 0;
+
+  while (start < output.length())
+  {
+    size_t stop = output.find('\n', start);
+    if (stop == std::string::npos)
+      stop = output.length();
+
+    size_t last = (stop > start)?output.find_last_not_of(" \t\r", stop - 1):std::string::npos;
+    if (last != std::string::npos && last >= start)
+      normal.append(output, start, last + 1 - start);
+    normal += '\n';
+    start = stop + 1;
+  }
+
+  size_t last = normal.find_last_not_of('\n');
+  normal.erase((last == std::string::npos)?0:last + 1);
+  return normal;
+}
+
+static std::string GetLine(const std::string &text, size_t index)
+{
+  size_t start = 0;
+  for (size_t i = 0; i < index && start != std::string::npos; i++)
+  {
+    start = text.find('\n', start);
+    if (start != std::string::npos)
+      start++;
+  }
+
+  if (start == std::string::npos || start > text.length())
+    return "";
+  return text.substr(start, text.find('\n', start) - start);
+}
+
+// Empties a directory, or makes it if it isn't there.
+static bool ResetDirectory(std::string directory)
+{
+  GradingCompiler::RemoveTree(directory);
+  return wxMkdir(directory);
+}
+
+static size_t CountLines(const std::string &text)
+{
+  if (text.empty())
+    return 0;
+  return std::count(text.begin(), text.end(), '\n') + 1;
+}
+
+//-----GradingTests-----
+
+GradingTests::GradingTests(std::string root, const sAssignmentPart &part, const GradingRubric *tmpl,
+  const std::vector<sTestCase> &tests):
+  GradingRosterTool(root, part),
+  m_template(tmpl),
+  m_tests(tests)
+{
+  m_marked = 0;
+}
+
+GradingTests::~GradingTests()
+{
+}
+
+size_t GradingTests::GetMarkedCount() const
+{
+  return m_marked;
+}
+
+const std::vector<sTestRow> &GradingTests::GetRows() const
+{
+  return m_rows;
+}
+
+bool GradingTests::OnScan()
+{
+  std::string dataDirectory = wxStandardPaths::Get().GetUserDataDir().c_str();
+  m_scratchDirectory = dataDirectory + "/tests";
+  if (!wxDirExists(dataDirectory))
+    wxMkdir(dataDirectory);
+  if (!wxDirExists(m_scratchDirectory))
+    wxMkdir(m_scratchDirectory);
+
+  m_rows.clear();
+  m_rows.resize(m_roster.GetCount());
+  for (size_t i = 0; i < m_rows.size(); i++)
+  {
+    m_rows[i].student = m_roster.GetStudent(i);
+    m_rows[i].tested = m_rows[i].compiled = m_rows[i].marked = false;
+    m_rows[i].passed = m_rows[i].failed = 0;
+    m_rows[i].compileMilliseconds = -1;
+    m_rows[i].milliseconds.assign(m_tests.size(), -1);
+  }
+
+  return true;
+}
+
+void GradingTests::OnRunStart(int threads)
+{
+  m_marked = 0;
+}
+
+void GradingTests::ProcessStudent(size_t index)
+{
+  sTestRow &row = m_rows[index];
+  std::string dirname = m_roster.GetStudentPath(index);
+
+  // Everything runs in the scratch directory, so the paths it's given can't
+  // be relative to this one.
+  if (!wxIsAbsolutePath(dirname.c_str()))
+    dirname = std::string(wxGetCwd().c_str()) + '/' + dirname;
+
+  sPartFiles files;
+  if (!m_roster.GetManifest()->GetPartFiles(dirname, m_part, &files))
+  {
+    AddError(row.student + ": couldn't open the student's directory");
+    return;
+  }
+
+  if (files.submissions.size() == 0)
+    return;
+
+  if (files.gradeFilename.empty())
+  {
+    AddError(row.student + ": no grade file matching " + m_part.gradeFileFilter);
+    return;
+  }
+
+  // Whoever's been graded already is left to their grader. A sheet that's
+  // still pending was only ever touched by the tests, so it can go.
+  std::string scoreFilename = GradingSheet::ScoreFilename(dirname + '/' + files.gradeFilename);
+  if (wxFileExists(scoreFilename))
+  {
+    GradingSheet sheet;
+    sParseError error;
+    if (!sheet.Load(scoreFilename, &error))
+    {
+      AddError(row.student + ": couldn't read " + scoreFilename + " (" + error.ToString() + ")");
+      return;
+    }
+
+    if (sheet.m_pending.empty())
+      return;
+  }
+
+  // Anything left over from a run that was cut short goes first. Every
+  // command runs in a work directory that's emptied before it starts, so
+  // nothing one leaves behind is seen by the next, and nothing lands in the
+  // grader's directory.
+  std::string output = wxString::Format("%s/run-%u", m_scratchDirectory.c_str(), (unsigned int)index).c_str();
+  std::string work = wxString::Format("%s/work-%u", m_scratchDirectory.c_str(), (unsigned int)index).c_str();
+  if (!ResetDirectory(output))
+  {
+    AddError(row.student + ": couldn't make " + output);
+    return;
+  }
+
+  row.compiled = true;
+  if (!m_part.compileCommand.empty())
+  {
+    sProcessResult result;
+    if (!ResetDirectory(work) || !m_launcher.Run(GradingCompiler::BuildCommand(m_part.compileCommand, dirname,
+      files.submissions, output), work, "", COMPILE_SECONDS, 0, &result))
+    {
+      AddError(row.student + ": couldn't run " + m_part.compileCommand);
+      GradingCompiler::RemoveTree(output);
+      GradingCompiler::RemoveTree(work);
+      return;
+    }
+
+    row.compiled = !result.timedOut && !result.truncated && result.status == 0;
+    row.compileMilliseconds = result.milliseconds;
+  }
+
+  row.tested = true;
+
+  GradingSheet sheet(m_template);
+  std::string failures;
+  for (size_t i = 0; row.compiled && i < m_tests.size(); i++)
+  {
+    const sTestCase &test = m_tests[i];
+
+    std::string inputFilename;
+    if (!test.input.empty())
+    {
+      inputFilename = output + wxString::Format("/input-%u.txt", (unsigned int)i).c_str();
+      if (!WriteFileAtomically(inputFilename, test.input))
+      {
+        AddError(row.student + ": couldn't write " + inputFilename);
+        continue;
+      }
+    }
+
+    sProcessResult result;
+    if (!ResetDirectory(work) || !m_launcher.Run(GradingCompiler::BuildCommand(test.command, dirname, files.submissions,
+      output), work, inputFilename, test.seconds, test.megabytes, &result))
+    {
+      AddError(row.student + ": couldn't run the test for \"" + test.label + "\"");
+      continue;
+    }
+    row.milliseconds[i] = result.milliseconds;
+
+    std::string failure;
+    if (CheckResult(test, result, &failure))
+      row.passed++;
+    else
+    {
+      row.failed++;
+      sheet.SetDeductionBox(test.category, test.deduction, test.box, true);
+      failures += test.label + ": " + failure + '\n';
+    }
+  }
+
+  GradingCompiler::RemoveTree(output);
+  GradingCompiler::RemoveTree(work);
+
+  // Nothing can be said about the tests if it doesn't compile; that has
+  // deductions of its own.
+  if (!row.compiled)
+  {
+    row.report = "Doesn't compile, so nothing was tested.\n";
+    return;
+  }
+
+  row.report = wxString::Format("%d of %d tests passed.\n", row.passed, row.passed + row.failed).c_str() + failures;
+  sheet.m_pending = row.report;
+
+  if (!sheet.SaveScoreFile(scoreFilename))
+  {
+    AddError(row.student + ": couldn't write " + scoreFilename);
+    return;
+  }
+
+  row.marked = true;
+
+  wxMutexLocker lock(m_mutex);
+  m_marked++;
+}
+
+// Returns whether the test passed, and if it didn't, failure says why.
+bool GradingTests::CheckResult(const sTestCase &test, const sProcessResult &result, std::string *failure)
+{
+  std::string printed = NormalizeOutput(result.output);
+
+  if (result.timedOut)
+    *failure = wxString::Format("ran out of time (%d seconds)", test.seconds).c_str();
+  else if (result.truncated)
+    *failure = wxString::Format("printed more than %u KB", (unsigned int)(GradingLauncher::MAX_OUTPUT >> 10)).c_str();
+  else if (result.status != 0)
+  {
+    *failure = wxString::Format("exited with status %d", result.status).c_str();
+    if (!printed.empty())
+      *failure += " (" + GetLine(printed, CountLines(printed) - 1) + ")";
+  }
+  else if (test.checkOutput && printed != NormalizeOutput(test.expected))
+  {
+    std::string expected = NormalizeOutput(test.expected);
+    size_t line = 0;
+    while (GetLine(expected, line) == GetLine(printed, line))
+      line++;
+
+    *failure = wxString::Format("line %u should be \"%s\" but was \"%s\"", (unsigned int)line + 1,
+      GetLine(expected, line).c_str(), GetLine(printed, line).c_str()).c_str();
+    if (line >= CountLines(printed))
+      *failure = wxString::Format("line %u should be \"%s\" but there wasn't one", (unsigned int)line + 1,
+        GetLine(expected, line).c_str()).c_str();
+    else if (line >= CountLines(expected))
+      *failure = wxString::Format("printed too much, starting with \"%s\" on line %u",
+        GetLine(printed, line).c_str(), (unsigned int)line + 1).c_str();
+  }
+  else if (!test.pattern.empty() && !wxRegEx(test.pattern.c_str(), wxRE_DEFAULT | wxRE_NEWLINE).Matches(printed.c_str()))
+    *failure = "printed nothing matching " + test.pattern;
+  else
+    return true;
+
+  return false;
+}
+
+int GradingTests::Main(int argc, char **argv)
+{
+  if (argc != 5 || std::string(argv[1]) != "--test")
+  {
+    fprintf(stderr, "usage: %s --test <part> <roster root> <template>\n", argv[0]);
+    return 2;
+  }
+
+  sAssignmentPart part;
+  GradingSheet tmpl;
+  if (!LoadPart(argv[2], &part) || !LoadTemplate(argv[4], &tmpl))
+    return 1;
+
+  sParseError error;
+  std::vector<sTestCase> cases;
+  if (!LoadTestCases(argv[4], tmpl.GetRubric(), &cases, &error))
+  {
+    fprintf(stderr, "The tests in %s don't look right (%s).\n", argv[4], error.ToString().c_str());
+    return 1;
+  }
+
+  if (cases.size() == 0)
+  {
+    fprintf(stderr, "The template %s doesn't have any tests in it.\n", argv[4]);
+    return 1;
+  }
+
+  GradingTests tests(argv[3], part, tmpl.GetRubric(), cases);
+  if (!tests.Scan())
+  {
+    fprintf(stderr, "I couldn't open the roster directory %s.\n", argv[3]);
+    return 1;
+  }
+
+  tests.Run();
+
+  // Everyone who was tested, and whatever they failed.
+  const std::vector<sTestRow> &rows = tests.GetRows();
+  size_t tested = 0;
+  for (size_t i = 0; i < rows.size(); i++)
+  {
+    if (!rows[i].tested)
+      continue;
+
+    tested++;
+    if (!rows[i].compiled)
+    {
+      printf("%s: doesn't compile\n", rows[i].student.c_str());
+      continue;
+    }
+
+    printf("%s: %d of %d passed\n", rows[i].student.c_str(), rows[i].passed, rows[i].passed + rows[i].failed);
+    for (size_t line = 1; line + 1 < CountLines(rows[i].report); line++)
+      printf("  %s\n", GetLine(rows[i].report, line).c_str());
+  }
+
+  // How long everything took, so the slow ones stand out.
+  if (tested > 0)
+    printf("Timing:\n");
+  for (int test = -1; tested > 0 && test < (int)cases.size(); test++)
+  {
+    long total = 0, slowest = -1;
+    size_t runs = 0, slowestRow = 0;
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+      long milliseconds = (test < 0)?rows[i].compileMilliseconds:rows[i].milliseconds[test];
+      if (milliseconds < 0)
+        continue;
+
+      total += milliseconds;
+      runs++;
+      if (milliseconds > slowest)
+      {
+        slowest = milliseconds;
+        slowestRow = i;
+      }
+    }
+
+    if (runs == 0)
+      continue;
+
+    printf("  %s: %ld ms on average, %ld ms at most (%s)\n", (test < 0)?"compiling":cases[test].label.c_str(),
+      total / (long)runs, slowest, rows[slowestRow].student.c_str());
+  }
+
+  tests.PrintErrors();
+  const std::vector<std::string> &errors = tests.GetErrors();
+
+  printf("Tested %u of %u students; marked %u sheets for grading (%u errors).\n",
+    (unsigned int)tested, (unsigned int)tests.GetStudentCount(), (unsigned int)tests.GetMarkedCount(),
+    (unsigned int)errors.size());
+
+  return errors.size() > 0;
+}
@@ -0,0 +1,107 @@
+#ifndef GRADINGTESTS_H
+#define GRADINGTESTS_H
+
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+#include "GradingLauncher.h"
+#include "GradingRosterTool.h"
+
+// A template can attach a test to any box: a simple deduction, or one of an
+// umbrella deduction's criteria. The test's lines go right under the box's,
+// indented one more:
+//
+//   	DED [O] [-2, -3] prints incorrect value or crashes in some cases:
+//   		CRT [O] test 1: string has an even length ("method")
+//   			TST java -cp %o Tester printEveryOther
+//   			IN method
+//   			OUT m t o
+//   			LIM 5 256
+//
+//   TST command  - Starts a test. The command gets the same %f, %o and %d as
+//                  the part's compile command, with %o holding the compiled
+//                  classes.
+//   IN text      - A line of the command's standard input.
+//   OUT text     - A line of what it's expected to print.
+//   RGX pattern  - A regular expression it has to print something matching,
+//                  instead of OUT.
+//   LIM s mb     - Its time limit in seconds and memory limit in megabytes,
+//                  0 for none. Without one, tests get 10 seconds and no
+//                  memory limit.
+//
+// A test fails if it runs out of time, doesn't exit with 0, or prints the
+// wrong thing (ignoring spaces at the ends of lines and blank lines at the
+// end). Without OUT or RGX, only the exit status counts. Score sheets drop
+// everything but the rubric, so the tests only ever live in the template.
+
+struct sTestCase
+{
+  int category;
+  int deduction;
+  int box;             // Within the deduction.
+  std::string label;   // The box's, for reports.
+  std::string command;
+  std::string input;
+  std::string expected;
+  bool checkOutput;    // Whether there were any OUT lines.
+  std::string pattern;
+  int seconds;
+  int megabytes;       // 0 for no limit.
+};
+
+bool LoadTestCases(std::string filename, const GradingRubric *tmpl, std::vector<sTestCase> *tests, sParseError *error = NULL);
+
+// The runner compiles each student's submissions into a scratch directory,
+// runs every test on them and marks the boxes of the tests that failed on a
+// fresh sheet from the template. The sheet is written to their .ss with what
+// happened attached (see GradingSheet::m_pending), but their grade file is
+// left alone; the marks only count once a grader has opened the student and
+// saved them. Students somebody has already graded aren't touched, but ones
+// that were only marked by an earlier run are marked again from scratch.
+// Students are handed out to a pool of worker threads (see GradingRosterTool),
+// and each one's tests run one after another through GradingLauncher, which
+// holds them to their limits and times them.
+
+struct sTestRow
+{
+  std::string student;
+  bool tested;    // False if they were already graded, or had nothing to test.
+  bool compiled;
+  int passed;
+  int failed;
+  bool marked;    // True if a sheet was written for them.
+  std::string report;
+  long compileMilliseconds;         // -1 if they weren't compiled.
+  std::vector<long> milliseconds;   // Each test's, or -1 if it wasn't run.
+};
+
+class GradingTests: public GradingRosterTool
+{
+  public:
+  GradingTests(std::string root, const sAssignmentPart &part, const GradingRubric *tmpl,
+    const std::vector<sTestCase> &tests);
+  ~GradingTests();
+
+  size_t GetMarkedCount() const;
+  const std::vector<sTestRow> &GetRows() const;
+
+  // Command line entry point: grader --test <part> <roster root> <template>
+  static int Main(int argc, char **argv);
+
+  protected:
+  const GradingRubric *m_template;
+  std::vector<sTestCase> m_tests;
+  std::string m_scratchDirectory;
+
+  std::vector<sTestRow> m_rows;
+  size_t m_marked;
+  GradingLauncher m_launcher;
+
+  bool OnScan();
+  void OnRunStart(int threads);
+  void ProcessStudent(size_t index);
+  static bool CheckResult(const sTestCase &test, const sProcessResult &result, std::string *failure);
+};
+
+#endif
@@ -2,329 +2,182 @@
 #include "GradingTools.h"
 
 #include "wx/dir.h"
+#include "wx/renderer.h"
 #include <sstream>
 #include <fstream>
 
-// You don't have to free the pointer returned by this, and you shouldn't.
-char *formatFloat(float x)
-{
-  // Clearly, just making this static could cause problems.
-  // But it won't.
-  static char s[32];
-
-  if (fabsf(x) - (int)fabsf(x) < 0.01f)
-    sprintf(s, "%d", (int)x);
-  else if (fabsf(x) - (int)fabsf(x) < 0.1f)
-    sprintf(s, "%.2f", x);
-  else
-    sprintf(s, "%.1f", x);
-
-  return s;
-}
-
-//-----GradingString-----
+DEFINE_EVENT_TYPE(wxEVT_GRADING_MODIFIED)
 
-GradingString::GradingString():
-  m_precedes(0),
-  m_owner(NULL)
+// Shading for whatever the rules turned up, on the checklist and in the files.
+static wxColour SuggestedColour()
 {
+  return wxColour(255, 236, 160);
 }
 
-GradingString::GradingString(std::string text, int precedes, GradingTools *owner):
-  m_text(text),
-  m_precedes(precedes),
-  m_owner(owner)
-{
-}
-
-GradingString::GradingString(const GradingString &s)
-{
-  *this = s;
-}
-
-GradingString &GradingString::operator=(const GradingString &s)
-{
-  m_text = s.m_text;
-  m_precedes = s.m_precedes;
-  m_owner = s.m_owner;
-
-  return *this;
-}
-
-std::string GradingString::Print() const
-{
-  std::stringstream ssIn(m_text);
-  std::stringstream ssOut;
-
-  bool notFirst = false;
-  while (ssIn.good())
-  {
-    std::string tok;
-    getline(ssIn, tok, '%');
-    if (notFirst)
-    {
-      if (tok[0] == 't')
-        ssOut << formatFloat(m_owner->GetTotalPoints()) << tok.substr(1);
-      else if (tok[0] == 'm')
-        ssOut << formatFloat(m_owner->GetMaxPoints()) << tok.substr(1);
-    }
-    else
-      ssOut << tok;
-    notFirst = true;
-  }
-
-  return ssOut.str();
-}
+//-----GradingChecklist-----
 
-std::string GradingString::ToString() const
-{
-  return "STR " + m_text;
-}
+IMPLEMENT_CLASS(GradingChecklist, wxVListBox)
 
-//-----GradingDeduction-----
+BEGIN_EVENT_TABLE(GradingChecklist, wxVListBox)
+  EVT_LEFT_DOWN(GradingChecklist::OnLeftDown)
+  EVT_LEFT_DCLICK(GradingChecklist::OnLeftDown)
+  EVT_KEY_DOWN(GradingChecklist::OnKeyDown)
+END_EVENT_TABLE()
 
-GradingDeduction::GradingDeduction()
+GradingChecklist::GradingChecklist(wxWindow *parent, wxWindowID id, GradingSheet *sheet):
+  wxVListBox(parent, id, wxDefaultPosition, wxSize(250, 300), wxSUNKEN_BORDER)
 {
-  m_label = "";
-  m_recorded = 0.0f;
-}
+  m_sheet = sheet;
 
-GradingDeduction::GradingDeduction(std::string label)
-{
-  SetLabel(label);
-  m_recorded = 0.0f;
+  m_boldFont = GetFont();
+  m_boldFont.SetWeight(wxFONTWEIGHT_BOLD);
 }
 
-GradingDeduction::GradingDeduction(const GradingDeduction &d)
+GradingChecklist::~GradingChecklist()
 {
-  *this = d;
 }
 
-GradingDeduction &GradingDeduction::operator=(const GradingDeduction &d)
+// Flattens the sheet into rows. This is the only part that looks at every box,
+// and it's just a few ints each.
+void GradingChecklist::Build()
 {
-  m_label = d.m_label;
-  m_mapping = d.m_mapping;
-  m_choices = d.m_choices;
-  m_recorded = d.m_recorded;
-  m_checkboxes = d.m_checkboxes;
-
-  return *this;
-}
+  m_rows.clear();
 
-void GradingDeduction::SetLabel(std::string label)
-{
-  // Vestigial template-generalizing code
-/*
-  if (label.find(":") != std::string::npos)
+  const std::vector<GradingCategory> &categories = m_sheet->GetCategories();
+  for (int i = 0; i < (int)categories.size(); i++)
   {
-    int ind = 0;
-    if ((ind = label.find(" or ")) != std::string::npos)
-      label.erase(ind, label.find_first_of(" ", ind + 4) - ind);
-    if ((ind = label.find_first_of("123456789")) != std::string::npos)
-      label[ind] = '#';
-  }
-*/
-  m_label = label;
-}
-
-void GradingDeduction::SetCheckbox(int index, bool state)
-{
-  m_checkboxes[index]->SetValue(state);
-}
-
-void GradingDeduction::SetMapping(int index, float value)
-{
-  index--;
+    sRow category = {ROW_CATEGORY, i, -1, -1};
+    m_rows.push_back(category);
 
-  if ((unsigned int)index >= m_mapping.size())
-    m_mapping.resize(index + 1, (m_mapping.size() > 0)?m_mapping[m_mapping.size() - 1]:0.0f);
-
-  m_mapping[index] = value;
-}
-
-float GradingDeduction::GetValue() const
-{
-  int t = 0;
-
-  for (unsigned int i = 0; i < m_checkboxes.size(); i++)
-    if (m_checkboxes[i]->GetValue())
-      t++;
-
-  if (t == 0)
-    return 0.0f;
+    for (int j = 0; j < (int)categories[i].m_dedux.size(); j++)
+    {
+      const GradingDeduction &ded = categories[i].m_dedux[j];
 
-  t--;
+      if (ded.m_choices.size() > 0)
+      {
+        sRow heading = {ROW_DEDUCTION, i, j, -1};
+        m_rows.push_back(heading);
+      }
 
-  if (m_mapping.size() <= t)
-    return m_mapping[m_mapping.size() - 1];
+      for (int k = 0; k < (int)ded.GetBoxCount(); k++)
+      {
+        sRow box = {ROW_BOX, i, j, k};
+        m_rows.push_back(box);
+      }
+    }
+  }
 
-  return m_mapping[t];
+  SetItemCount(m_rows.size());
+  RefreshAll();
 }
 
-float GradingDeduction::GetMaxValue() const
+void GradingChecklist::Clear()
 {
-  return m_mapping[m_mapping.size() - 1];
+  m_rows.clear();
+  m_suggested.Assign(0);
+  SetItemCount(0);
+  RefreshAll();
 }
 
-void GradingDeduction::UpdateTotal(float *total)
+// The set is numbered the same way as the sheet's boxes.
+void GradingChecklist::SetSuggested(const GradingBoxSet &suggested)
 {
-  *total -= m_recorded;
-  *total += (m_recorded = GetValue());
+  m_suggested = suggested;
+  RefreshAll();
 }
 
-void GradingDeduction::AddChoice(std::string label)
+wxCoord GradingChecklist::OnMeasureItem(size_t n) const
 {
-  m_choices.push_back(label);
+  return GetCharHeight() + 6;
 }
 
-std::string GradingDeduction::Print() const
+void GradingChecklist::OnDrawItem(wxDC &dc, const wxRect &rect, size_t n) const
 {
-  std::stringstream s;
+  const sRow &row = m_rows[n];
+  const GradingCategory &cat = m_sheet->GetCategories()[row.cat];
+  int indent = GetCharHeight();
+  int x = rect.x + 2;
+  std::string label;
 
-  if (GetValue() == 0.0f)
-    return "";
+  dc.SetTextForeground(IsSelected(n)?wxSystemSettings::GetColour(wxSYS_COLOUR_HIGHLIGHTTEXT):GetForegroundColour());
 
-  if (m_choices.size() == 0)
-    s << "  " << formatFloat(GetValue()) << " " << m_label << '\n';
-  else
+  if (row.type == ROW_CATEGORY)
   {
-    std::string label = m_label;
-    int t = 0;
-    //int ind = 0;
-    for (unsigned int i = 0; i < m_checkboxes.size(); i++)
-      if (m_checkboxes[i]->GetValue())
-        t++;
-    //if (t == 1 && label[ind = (label.find(":") - 1)] == 's')
-    //  label.erase(ind, 1);
-    //label[label.find_first_of("#")] = (char)(t + '0');
-    s << "  " << formatFloat(GetValue()) << " " << label << '\n';
-    for (unsigned int i = 0; i < m_checkboxes.size(); i++)
-      if (m_checkboxes[i]->GetValue())
-        s << "    " << m_choices[i] << '\n';
-  }
-
-  return s.str();
-}
-
-void GradingDeduction::Reset()
-{
-  for (unsigned int i = 0; i < m_checkboxes.size(); i++)
-    m_checkboxes[i]->SetValue(false);
-  m_recorded = 0.0f;
-}
-
-wxSizer *GradingDeduction::BuildPanel(wxWindow *parent, int *currentID)
-{
-  char buffer[512];
-  wxBoxSizer *sizer;
-
-  if (m_choices.size() > 0)
-  {
-    sprintf(buffer, "%s", m_label.c_str());
-    sizer = new wxStaticBoxSizer(wxVERTICAL, parent, buffer);
-    for (unsigned int i = 0; i < m_choices.size(); i++)
-    {
-      wxCheckBox *check = new wxCheckBox(parent, (*currentID)++, m_choices[i].c_str(), wxDefaultPosition, wxDefaultSize);
-      check->SetValue(false);
-      sizer->Add(check, 0, wxALL | wxALIGN_CENTER_VERTICAL, 0);
-      m_checkboxes.push_back(check);
-    }
+    dc.SetFont(m_boldFont);
+    label = formatFloat(cat.m_value) + " " + cat.m_label;
   }
   else
   {
-    sizer = new wxBoxSizer(wxVERTICAL);
-
-    sprintf(buffer, "%s %s", formatFloat(m_mapping[0]), m_label.c_str());
-    wxCheckBox *check = new wxCheckBox(parent, (*currentID)++, buffer, wxDefaultPosition, wxDefaultSize);
-    check->SetValue(false);
-    sizer->Add(check, 0, wxALL | wxALIGN_CENTER_VERTICAL, 0);
-    m_checkboxes.push_back(check);
-  }
-
-  sizer->Layout();
-
-  return sizer;
-}
+    const GradingDeduction &ded = cat.m_dedux[row.ded];
 
-std::string GradingDeduction::ToString() const
-{
-  std::stringstream str;
-  str << "\tDED ";
-
-  if (m_choices.size() == 0 && m_checkboxes.size() > 0 && m_checkboxes[0]->GetValue())
-    str << "[X] [";
-  else
-    str << "[O] [";
-
-  for (size_t i = 0; i < m_mapping.size(); i++)
-    str << m_mapping[i] << ((i < m_mapping.size() - 1)?", ":"");
-  str << "] " << m_label;
-
-  for (size_t i = 0; i < m_choices.size(); i++)
-    str << "\n\t\tCRT " << (m_checkboxes.size() > i && m_checkboxes[i]->GetValue()?"[X] ":"[O] ") << m_choices[i];
+    dc.SetFont(GetFont());
+    x += indent;
 
-  return str.str();
-}
+    if (row.type == ROW_DEDUCTION)
+      label = ded.m_label;
+    else
+    {
+      // Criteria sit under their deduction's heading.
+      if (ded.m_choices.size() > 0)
+      {
+        x += indent;
+        label = ded.m_choices[row.box];
+      }
+      else
+        label = formatFloat(ded.m_mapping[0]) + " " + ded.m_label;
 
-//-----GradingCategory-----
+      size_t index = ded.m_firstBox + row.box;
+      if (!IsSelected(n) && index < m_suggested.GetSize() && m_suggested.Get(index))
+      {
+        dc.SetBrush(wxBrush(SuggestedColour()));
+        dc.SetPen(wxPen(SuggestedColour()));
+        dc.DrawRectangle(rect);
+      }
 
-GradingCategory::GradingCategory()
-{
-  m_value = 0.0f;
-  m_label = "";
-}
+      int size = rect.height - 6;
+      wxRect box(x, rect.y + (rect.height - size) / 2, size, size);
+      int flags = m_sheet->GetDeductionBox(row.cat, row.ded, row.box)?wxCONTROL_CHECKED:0;
+      wxRendererNative::Get().DrawCheckBox(const_cast<GradingChecklist *>(this), dc, box, flags);
 
-GradingCategory::GradingCategory(float value, std::string label, std::vector<GradingDeduction> dedux)
-{
-  m_value = value;
-  m_label = label;
-  m_dedux = dedux;
-}
+      x += size + 4;
+    }
+  }
 
-GradingCategory::GradingCategory(const GradingCategory &c)
-{
-  *this = c;
+  dc.DrawText(label.c_str(), x, rect.y + (rect.height - dc.GetCharHeight()) / 2);
 }
 
-GradingCategory &GradingCategory::operator=(const GradingCategory &c)
+void GradingChecklist::Toggle(size_t n)
 {
-  m_value = c.m_value;
-  m_label = c.m_label;
-  m_dedux = c.m_dedux;
-
-  return *this;
-}
+  const sRow &row = m_rows[n];
+  if (row.type != ROW_BOX)
+    return;
 
-void GradingCategory::UpdateTotal(float *total)
-{
-  for (size_t i = 0; i < m_dedux.size(); i++)
-    m_dedux[i].UpdateTotal(total);
-}
+  m_sheet->SetDeductionBox(row.cat, row.ded, row.box, !m_sheet->GetDeductionBox(row.cat, row.ded, row.box));
+  RefreshLine(n);
 
-void GradingCategory::AddDeduction(GradingDeduction d)
-{
-  m_dedux.push_back(d);
+  wxCommandEvent e(wxEVT_COMMAND_CHECKLISTBOX_TOGGLED, GetId());
+  e.SetInt(n);
+  e.SetEventObject(this);
+  GetEventHandler()->ProcessEvent(e);
 }
 
-void GradingCategory::SetDeductionBox(int deduction, int box, bool state)
+// Clicking anywhere on a row toggles it, same as clicking a checkbox's label.
+// The click still goes on to the list so the row gets selected.
+void GradingChecklist::OnLeftDown(wxMouseEvent &e)
 {
-  m_dedux[deduction].SetCheckbox(box, state);
-}
+  int n = HitTest(e.GetPosition());
+  if (n != wxNOT_FOUND)
+    Toggle(n);
 
-void GradingCategory::Reset()
-{
-  for (unsigned int i = 0; i < m_dedux.size(); i++)
-    m_dedux[i].Reset();
+  e.Skip();
 }
 
-std::string GradingCategory::ToString() const
+void GradingChecklist::OnKeyDown(wxKeyEvent &e)
 {
-  std::stringstream str;
-  str << "CAT [" << m_value << "] " << m_label;
-  for (size_t i = 0; i < m_dedux.size(); i++)
-    str << "\n" << m_dedux[i].ToString();
-
-  return str.str();
+  if (e.GetKeyCode() == WXK_SPACE && GetSelection() != wxNOT_FOUND)
+    Toggle(GetSelection());
+  else
+    e.Skip();
 }
 
 //-----GradingPanel-----
@@ -332,15 +185,17 @@ std::string GradingCategory::ToString() const
 IMPLEMENT_CLASS(GradingPanel, wxScrolledWindow)
 
 BEGIN_EVENT_TABLE(GradingPanel, wxScrolledWindow)
-  EVT_COMMAND_RANGE(ID_DEDUCTION, ID_DEDUCTION + 99, wxEVT_COMMAND_CHECKBOX_CLICKED, GradingPanel::OnDeduction)
+  EVT_CHECKLISTBOX(ID_CHECKLIST, GradingPanel::OnDeduction)
+  EVT_TEXT(ID_NOTE, GradingPanel::OnNotes)
 END_EVENT_TABLE()
 
-GradingPanel::GradingPanel(wxWindow* parent, float *total):
+GradingPanel::GradingPanel(wxWindow* parent, GradingSheet *sheet):
   wxScrolledWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize)
 {
-  m_currentID = ID_DEDUCTION;
-
-  m_total = total;
+  m_sheet = sheet;
+  m_saved = true;
+  m_modified = false;
+  m_settingNotes = false;
 
   wxBoxSizer *topSizer = new wxBoxSizer(wxVERTICAL);
 
@@ -350,13 +205,15 @@ GradingPanel::GradingPanel(wxWindow* parent, float *total):
 
   // Deductions
   wxStaticBoxSizer *sizer = new wxStaticBoxSizer(wxVERTICAL, this, "Deductions");
-  topSizer->Add(sizer, 0, wxGROW | wxALIGN_CENTER | wxALL, 2);
-  m_deduxBox = sizer;
+  m_checklist = new GradingChecklist(this, ID_CHECKLIST, m_sheet);
+
+  sizer->Add(m_checklist, 1, wxGROW | wxALL, 2);
+  topSizer->Add(sizer, 3, wxGROW | wxALIGN_CENTER | wxALL, 2);
 
   // Notes
   sizer = new wxStaticBoxSizer(wxVERTICAL, this, "Notes");
   sizer->SetMinSize(0, 150);
-  m_notesText = new wxRichTextCtrl(this);
+  m_notesText = new wxRichTextCtrl(this, ID_NOTE);
 
   sizer->Add(m_notesText, 1, wxGROW | wxALL, 2);
   sizer->Layout();
@@ -375,40 +232,60 @@ GradingPanel::~GradingPanel()
 {
 }
 
+// The checklist has already changed the sheet by the time this gets called.
 void GradingPanel::OnDeduction(wxCommandEvent &e)
 {
-  //((GradingTools *)m_parent)->SetDeductionValue(e.GetId() - ID_DEDUCTION, e.IsChecked());
-  m_deduxMapping[e.GetId() - ID_DEDUCTION]->UpdateTotal(m_total);
-  SetPoints(*m_total);
+  SetPoints(m_sheet->m_totalPoints);
+  CheckModified();
 }
 
-void GradingPanel::AddCategory(GradingCategory &cat)
+void GradingPanel::OnNotes(wxCommandEvent &e)
 {
-  char buffer[512];
+  if (m_settingNotes)
+    return;
 
-  sprintf(buffer, "%s %s", formatFloat(cat.m_value), cat.m_label.c_str());
-  wxStaticBoxSizer *sizer = new wxStaticBoxSizer(wxVERTICAL, this, buffer);
+  CheckModified();
+}
 
-  for (unsigned int i = 0; i < cat.m_dedux.size(); i++)
-  {
-    sizer->Add(cat.m_dedux[i].BuildPanel(this, &m_currentID), 0, wxGROW | wxALL | wxALIGN_CENTER_VERTICAL, 2);
+// Tells the frame if the student has just become modified, or stopped being.
+void GradingPanel::CheckModified()
+{
+  bool modified = IsModified();
+  if (modified == m_modified)
+    return;
 
-    while (m_deduxMapping.size() < (m_currentID - ID_DEDUCTION))
-      m_deduxMapping.push_back(&cat.m_dedux[i]);
-  }
+  m_modified = modified;
 
-  m_deduxBox->Add(sizer, 0, wxGROW | wxALL, 6);
-  m_deduxBox->Layout();
-  m_deduxBox->SetSizeHints(m_parent);
+  wxCommandEvent e(wxEVT_GRADING_MODIFIED, GetId());
+  e.SetInt(modified);
+  e.SetEventObject(this);
+  GetEventHandler()->ProcessEvent(e);
+}
 
-  GetSizer()->Layout();
-  GetSizer()->SetSizeHints(this);
+// Builds the whole panel from the sheet, which should already be parsed.
+void GradingPanel::BuildPanel()
+{
+  m_checklist->Build();
+
+  SetNotes(m_sheet->m_notes);
+  SetPoints(m_sheet->m_totalPoints);
+}
+
+// Brings the checkboxes, notes and total up to date with the sheet, which has to
+// have the same structure as the one the panel was built from. The rows stay as
+// they are, so the list keeps its place.
+void GradingPanel::UpdatePanel()
+{
+  m_checklist->RefreshAll();
+
+  SetNotes(m_sheet->m_notes);
+  SetPoints(m_sheet->m_totalPoints);
 }
 
 void GradingPanel::SetPoints(float points)
 {
   char buffer[512];
-  sprintf(buffer, "Total score: %s", formatFloat(points));
+  sprintf(buffer, "Total score: %s", formatFloat(points).c_str());
 
   m_pointsText->SetLabel(buffer);
 }
@@ -418,17 +295,44 @@ std::string GradingPanel::GetNotes()
   return m_notesText->GetValue().c_str();
 }
 
+// SetValue sends a text event like typing does, which would have the new
+// student's notes checked against the last one's before MarkSaved catches up,
+// and the star in the title would blink on and off. Nobody typed anything, so
+// it's ignored.
 void GradingPanel::SetNotes(std::string notes)
 {
+  m_settingNotes = true;
   m_notesText->SetValue(notes);
+  m_settingNotes = false;
+}
+
+// Takes what's showing now as what's on disk. Students who haven't been saved
+// at all yet count as modified until they are.
+void GradingPanel::MarkSaved(bool saved)
+{
+  m_savedApplied = m_sheet->m_applied;
+  m_savedNotes = GetNotes();
+  m_saved = saved;
+
+  CheckModified();
+}
+
+// Unticking a box that was ticked when the student was loaded counts as going
+// back to unmodified; it's what's on the sheet that matters, not how it got there.
+bool GradingPanel::IsModified()
+{
+  return !m_saved || m_sheet->m_applied != m_savedApplied || GetNotes() != m_savedNotes;
+}
+
+void GradingPanel::SetSuggested(const GradingBoxSet &suggested)
+{
+  m_checklist->SetSuggested(suggested);
 }
 
 void GradingPanel::Reset()
 {
   m_notesText->SetValue("");
-  m_deduxBox->Clear(true);
-  m_deduxMapping.clear();
-  m_currentID = ID_DEDUCTION;
+  m_checklist->Clear();
 }
 
 //-----GradingText-----
@@ -445,6 +349,30 @@ GradingText::GradingText(std::string filename, wxWindow* parent):
   Load(filename);
 }
 
+// Shows a file that's already been read, usually by the prefetcher.
+GradingText::GradingText(const sStudentFile &file, wxWindow* parent):
+  wxRichTextCtrl(parent)
+{
+  SetFont(wxFont(8, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+
+  m_filename = file.filename;
+
+  if (!file.loaded)
+  {
+    wxMessageBox("I failed to open a file I was expecting to be able to open. What's the deal with that?", "Oops.", wxOK, m_parent);
+    return;
+  }
+
+  SetContent(file.view->GetData(), file.view->GetLength());
+}
+
+// An empty page, for text that doesn't come from a file.
+GradingText::GradingText(wxWindow* parent):
+  wxRichTextCtrl(parent)
+{
+  SetFont(wxFont(8, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+}
+
 GradingText::~GradingText()
 {
 }
@@ -453,52 +381,199 @@ void GradingText::Load(std::string filename)
 {
   m_filename = filename;
 
-  FILE *f = fopen(filename.c_str(), "r");
-  if (f == NULL)
+  GradingFileView view;
+  if (!view.Open(filename))
   {
     wxMessageBox("I failed to open a file I was expecting to be able to open. What's the deal with that?", "Oops.", wxOK, m_parent);
     return;
   }
-  fpos_t len;
 
-  fseek(f, 0, SEEK_END);
-  fgetpos(f, &len);
-  fseek(f, 0, SEEK_SET);
+  SetContent(view.GetData(), view.GetLength());
+}
+
+// Copies the file straight into the control, turning Windows line endings into
+// plain newlines on the way, since that's what the control expects.
+void GradingText::SetContent(const char *data, size_t length)
+{
+  wxString text;
+  text.Alloc(length);
+
+  const char *start = data, *end = data + length;
+  for (const char *pos = data; pos < end; pos++)
+  {
+    if (*pos == '\r' && pos + 1 < end && pos[1] == '\n')
+    {
+      text.append(start, pos - start);
+      start = pos + 1;
+    }
+  }
+  text.append(start, end - start);
+
+  ChangeValue(text);
+}
 
-  char *content = (char *)malloc(sizeof(char) * len);
-  fread(content, len, sizeof(char), f);
+// Shades a line, counting from 1, and scrolls to it if asked.
+void GradingText::HighlightLine(int line, bool show)
+{
+  long start = XYToPosition(0, line - 1);
+  if (line < 1 || start < 0)
+    return;
 
-  ChangeValue(wxString(content));
+  wxTextAttr style;
+  style.SetBackgroundColour(SuggestedColour());
+  SetStyle(start, start + GetLineLength(line - 1), style);
 
-  free(content);
-  fclose(f);
+  if (show)
+    ShowPosition(start);
 }
 
 void GradingText::Save()
 {
 }
 
+//-----GradingOutlineList-----
+
+IMPLEMENT_CLASS(GradingOutlineList, wxListBox)
+
+GradingOutlineList::GradingOutlineList(wxWindow *parent, wxWindowID id):
+  wxListBox(parent, id, wxDefaultPosition, wxSize(180, -1))
+{
+  SetFont(wxFont(8, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+}
+
+GradingOutlineList::~GradingOutlineList()
+{
+}
+
+// Lists every Java file with its classes under it, and their methods under
+// them. Returns false if there was nothing to list.
+bool GradingOutlineList::SetOutlines(const sStudentFiles &files)
+{
+  wxArrayString rows;
+  m_filenames.clear();
+  m_lines.clear();
+
+  for (size_t i = 0; i < files.outlines.size() && i < files.submissions.size(); i++)
+  {
+    const std::vector<sJavaClass> &classes = files.outlines[i].classes;
+    if (classes.size() == 0)
+      continue;
+
+    const std::string &filename = files.submissions[i].filename;
+    rows.Add(filename.c_str());
+    m_filenames.push_back(filename);
+    m_lines.push_back(1);
+
+    for (size_t j = 0; j < classes.size(); j++)
+    {
+      rows.Add(("  " + classes[j].kind + " " + classes[j].name).c_str());
+      m_filenames.push_back(filename);
+      m_lines.push_back(classes[j].line);
+
+      for (size_t k = 0; k < classes[j].methods.size(); k++)
+      {
+        rows.Add(("    " + classes[j].methods[k].ToString()).c_str());
+        m_filenames.push_back(filename);
+        m_lines.push_back(classes[j].methods[k].line);
+      }
+    }
+  }
+
+  Set(rows);
+  return m_lines.size() > 0;
+}
+
+bool GradingOutlineList::GetPlace(int row, std::string *filename, int *line) const
+{
+  if (row < 0 || row >= (int)m_lines.size())
+    return false;
+
+  *filename = m_filenames[row];
+  *line = m_lines[row];
+  return true;
+}
+
 //-----GradingTools-----
 
 IMPLEMENT_CLASS(GradingTools, wxPanel)
 
 BEGIN_EVENT_TABLE(GradingTools, wxPanel)
+  EVT_COMMAND(wxID_ANY, wxEVT_GRADING_WRITE_FAILED, GradingTools::OnWriteFailed)
+  EVT_COMMAND(wxID_ANY, wxEVT_GRADING_COMPILED, GradingTools::OnCompiled)
+  EVT_LISTBOX(ID_OUTLINE, GradingTools::OnOutline)
 END_EVENT_TABLE()
 
-std::vector<GradingTools::sAssignmentPart> GradingTools::s_assmtParts;
+std::vector<sAssignmentPart> GradingTools::s_assmtParts;
 
-GradingTools::GradingTools(int part, wxWindow *parent, std::string templateFilename):
+// The directory has to be spelled the way the roster spells it, since it's the
+// key for the writer's, the prefetcher's and the compiler's queues.
+GradingTools::GradingTools(int part, wxWindow *parent, std::string templateFilename, std::string directory,
+  GradingManifest *manifest):
   wxPanel(parent),
+  m_manifest(manifest),
+  m_directory(directory),
   m_templateFilename(templateFilename)
 {
   m_part = part;
-  m_totalPoints = 0;
 
-  m_panel = new GradingPanel(this, &m_totalPoints);
+  // The template is the same for every student without a .ss file yet, so it's
+  // only read once.
+  GradingSheet templateSheet;
+  sParseError error;
+  if (templateSheet.Load(m_templateFilename, &error))
+  {
+    templateSheet.Intern(&m_rubrics);
+    m_template = templateSheet.GetRubric();
+  }
+  else
+  {
+    wxMessageBox(("The template doesn't look right (" + error.ToString() + ").").c_str(), "Oops.", wxOK, parent);
+    m_template = NULL;
+  }
+
+  // So are its rules, if it has any.
+  m_matcher = NULL;
+  if (m_template && !LoadRules(m_templateFilename, m_template, &m_rules, &error))
+  {
+    wxMessageBox(("The rules in the template don't look right (" + error.ToString() + "), so I'm leaving them out.").c_str(),
+      "Oops.", wxOK, parent);
+    m_rules.clear();
+  }
+  if (m_rules.size() > 0)
+    m_matcher = new GradingRuleMatcher(m_rules, &m_outlines);
+
+  m_writer = new GradingWriter(this);
+  if (m_writer->Create() != wxTHREAD_NO_ERROR || m_writer->Run() != wxTHREAD_NO_ERROR)
+  {
+    delete m_writer;
+    m_writer = NULL;
+  }
+
+  if (m_manifest)
+    m_manifest->SetParts(s_assmtParts);
+
+  m_prefetch = new GradingPrefetch(s_assmtParts[m_part], m_template, m_writer, m_manifest, &m_rules, &m_outlines);
+  if (m_prefetch->Create() != wxTHREAD_NO_ERROR || m_prefetch->Run() != wxTHREAD_NO_ERROR)
+  {
+    delete m_prefetch;
+    m_prefetch = NULL;
+  }
+
+  m_compiler = NULL;
+  m_compilerText = NULL;
+  if (!s_assmtParts[m_part].compileCommand.empty())
+  {
+    m_compiler = new GradingCompiler(this, s_assmtParts[m_part], m_manifest);
+    m_compiler->Start();
+  }
+
+  m_panel = new GradingPanel(this, &m_sheet);
   m_notebook = new wxNotebook(this, wxID_ANY);
+  m_outline = new GradingOutlineList(this, ID_OUTLINE);
 
   wxBoxSizer *topSizer = new wxBoxSizer(wxHORIZONTAL);
 
+  topSizer->Add(m_outline, 0, wxGROW);
   topSizer->Add(m_notebook, 1, wxGROW);
   topSizer->Add(m_panel, 1, wxGROW);
 
@@ -511,46 +586,36 @@ GradingTools::GradingTools(int part, wxWindow *parent, std::string templateFilen
 
 GradingTools::~GradingTools()
 {
+  if (m_compiler)
+  {
+    m_compiler->Stop();
+    delete m_compiler;
+  }
+
+  if (m_prefetch)
+  {
+    m_prefetch->Stop();
+    m_prefetch->Wait();
+    delete m_prefetch;
+  }
+
+  // Stopping the writer still writes everything that's queued.
+  if (m_writer)
+  {
+    m_writer->Stop();
+    m_writer->Wait();
+    delete m_writer;
+  }
+
+  delete m_matcher;
 }
 
-#include <iostream>
 std::vector<wxString> GradingTools::GetAssignmentParts()
 {
   if (s_assmtParts.size() == 0)
   {
-    std::ifstream conf("parts_conf.txt", std::ios::in);
-    std::string tok;
-    sAssignmentPart *part = NULL;
-    while (conf.good())
-    {
-      conf >> tok;
-      if (tok[0] == '{')
-      {
-        sAssignmentPart p = {"[no name]", "*.*", "*.*"};
-        s_assmtParts.push_back(p);
-        part = &s_assmtParts[s_assmtParts.size() - 1];
-      }
-      else if (tok[0] != '}' && s_assmtParts.size() == 0)
-        wxMessageBox("The assignment parts description file is malformed.", "Error!", wxOK, NULL);
-
-      std::string *target = NULL;
-      if (tok == "name:")
-        target = &part->name;
-      else if (tok == "submissions:")
-        target = &part->submissionFilter;
-      else if (tok == "grade:")
-        target = &part->gradeFileFilter;
-
-      if (target == NULL)
-        continue;
-
-      getline(conf, *target);
-      size_t found = target->find_first_not_of(" \t");
-      if (found != std::string::npos)
-        *target = target->substr(found);
-      else
-        target->clear();
-    }
+    if (!LoadAssignmentParts("parts_conf.txt", &s_assmtParts))
+      wxMessageBox("The assignment parts description file is malformed.", "Error!", wxOK, NULL);
   }
 
   std::vector<wxString> names;
@@ -561,118 +626,161 @@ std::vector<wxString> GradingTools::GetAssignmentParts()
 
 void GradingTools::LoadScoreSheet(std::string filename, bool build)
 {
-  FILE *f = fopen(filename.c_str(), "r");
-  if (f == NULL)
+  sParseError error;
+  if (!m_sheet.Load(filename, &error))
   {
-    wxMessageBox("I failed to open a file I was expecting to be able to open. What's the deal with that?", "Oops.", wxOK, this);
+    wxMessageBox(("I failed to open a file I was expecting to be able to open. What's the deal with that? (" + error.ToString() + ")").c_str(), "Oops.", wxOK, this);
     return;
   }
 
-  fpos_t len;
-
-  fseek(f, 0, SEEK_END);
-  fgetpos(f, &len);
-  fseek(f, 0, SEEK_SET);
-
-  char *content = (char *)malloc(sizeof(char) * len);
-  memset(content, 0, sizeof(char) * len);
-  fread(content, len, sizeof(char), f);
-
-  ParseScoreSheet(content);
-
-  free(content);
-  fclose(f);
+  m_sheet.Intern(&m_rubrics);
+  m_panel->BuildPanel();
+  m_panel->MarkSaved();
 }
 
 // SaveScoreSheet prints out the grade file as it is meant to be returned to the student.
+// Both of these only queue the files up; they're written in the background.
 void GradingTools::SaveScoreSheet()
 {
-  FILE *f = fopen(m_filename.c_str(), "w+");
+  m_sheet.m_notes = m_panel->GetNotes();
+
+  // Saving is the grader agreeing with whatever the tests marked.
+  m_sheet.m_pending.clear();
 
-  int strInd = 0;
-  for (unsigned int i = 0; i < m_categories.size() - 1; i++)
+  if (m_filename.empty())
   {
-    while (strInd < m_strings.size() && m_strings[strInd].m_precedes <= i)
-      fprintf(f, "%s\n", m_strings[strInd++].Print().c_str());
-    fprintf(f, "%s\n", m_categories[i].m_label.c_str());
-    for (unsigned int j = 0; j < m_categories[i].m_dedux.size(); j++)
-      fprintf(f, "%s", m_categories[i].m_dedux[j].Print().c_str());
-    fprintf(f, "\n");
+    wxMessageBox("I couldn't write the grade file. Is it open somewhere else?", "Oops.", wxOK, this);
+    return;
   }
 
-  // Special case for no submission
-  if (m_categories[m_categories.size() - 1].m_dedux[0].GetValue() != 0.0f)
-    fprintf(f, "%s %s\n\n", formatFloat(-m_maxPoints), m_categories[m_categories.size() - 1].m_dedux[0].m_label.c_str());
-
-  if (m_panel->GetNotes().length() > 0)
-    fprintf(f, "Note: %s\n\n", m_panel->GetNotes().c_str());
-
-  while (strInd < m_strings.size())
-    fprintf(f, "%s\n", m_strings[strInd++].Print().c_str());
-
-  fclose(f);
-
+  QueueWrite(m_filename, m_sheet.PrintGradeFile());
   SaveScoreFile();
+  m_panel->MarkSaved();
 }
 
 // SaveScoreFile records grading information in the same format as templates, with
 // applied deductions marked and notes included.
 void GradingTools::SaveScoreFile()
 {
-  std::ofstream f((m_filename.substr(0, m_filename.find_last_of('.')) + ".ss").c_str(), std::ios::out);
+  m_sheet.m_notes = m_panel->GetNotes();
+  QueueWrite(GradingSheet::ScoreFilename(m_filename), m_sheet.ToString());
+}
 
-  int strInd = 0;
-  for (size_t i = 0; i < m_categories.size(); i++)
-  {
-    while (strInd < m_strings.size() && m_strings[strInd].m_precedes <= i)
-      f << m_strings[strInd++].ToString() << "\n";
-    f << m_categories[i].ToString() << "\n";
-  }
+// Without a writer thread, files are just written on the spot.
+void GradingTools::QueueWrite(std::string filename, std::string content)
+{
+  if (m_writer)
+    m_writer->Write(m_directory, filename, content);
+  else if (!WriteFileAtomically(filename, content))
+    wxMessageBox(("I couldn't write " + filename + ". Is it open somewhere else?").c_str(), "Oops.", wxOK, this);
+}
 
-  while (strInd < m_strings.size())
-    f << m_strings[strInd++].ToString() << "\n";
+void GradingTools::OnWriteFailed(wxCommandEvent &e)
+{
+  wxMessageBox("I couldn't write " + e.GetString() + ". Is it open somewhere else?", "Oops.", wxOK, this);
+}
 
-  f << "\nNOTES\n" << m_panel->GetNotes();
+// Results for other students are only kept until they're opened.
+void GradingTools::OnCompiled(wxCommandEvent &e)
+{
+  if (e.GetString() == m_directory.c_str())
+    ShowCompileResult();
 }
 
 void GradingTools::OpenFiles(bool build)
+{
+  sStudentFiles files;
+
+  // Whoever's being opened gets compiled next, if they haven't been already.
+  if (m_compiler)
+    m_compiler->Hurry(m_directory);
+
+  if (m_prefetch == NULL || !m_prefetch->Take(m_directory, &files))
+  {
+    // Don't read back a sheet that's still waiting to be saved.
+    if (m_writer)
+      m_writer->WaitFor(m_directory);
+    ReadStudentFiles(m_directory, s_assmtParts[m_part], m_template, &files, m_manifest, m_matcher, &m_outlines);
+  }
+
+  ShowFiles(files);
+}
+
+void GradingTools::ShowFiles(sStudentFiles &files)
 {
   m_texts.clear();
+  m_compilerText = NULL;
   m_notebook->DeleteAllPages();
 
-  wxDir dir(wxGetCwd());
+  // The outline only takes up room when there's some Java to show.
+  GetSizer()->Show(m_outline, m_outline->SetOutlines(files));
+  Layout();
 
-  if (!dir.IsOpened())
+  if (!files.opened)
   {
     wxMessageBox("I choked on something while trying to open the student's directory. Sorry.", "Uh oh!", wxOK, this);
+    m_sheet.Clear();
+    m_panel->Reset();
+    m_panel->MarkSaved();
     return;
   }
 
-  wxString filename, filter;
-
-  filter = s_assmtParts[m_part].submissionFilter;
-
-  bool more = dir.GetFirst(&filename, filter, wxDIR_FILES);
-  while (more)
+  for (size_t i = 0; i < files.submissions.size(); i++)
   {
-    m_texts.push_back(new GradingText(filename.c_str(), m_notebook));
+    m_texts.push_back(new GradingText(files.submissions[i], m_notebook));
     m_notebook->AddPage(m_texts[m_texts.size() - 1], m_texts[m_texts.size() - 1]->m_filename, true);
-    more = dir.GetNext(&filename);
   }
 
-  // Look for the official grade file
-  filter = s_assmtParts[m_part].gradeFileFilter;
-  if (dir.GetFirst(&filename, filter, wxDIR_FILES))
-    m_filename = filename;
-  else
+  // The compiler's page goes after the files, without taking the focus away
+  // from them.
+  if (m_compiler && files.submissions.size() > 0)
+  {
+    m_compilerText = new GradingText(m_notebook);
+    m_notebook->AddPage(m_compilerText, "Compiler", false);
+    ShowCompileResult();
+  }
+
+  m_filename = files.gradeFilename;
+  if (m_filename.empty())
     wxMessageBox("I couldn't find the grade file! I think something is horribly wrong.", "What.", wxOK, this);
 
-  // Look for the score sheet generated by this program
-  filter = "*.ss";
-  if (dir.GetFirst(&filename, filter, wxDIR_FILES))
-    LoadScoreSheet(filename.c_str(), build);
+  if (files.sheetLoaded)
+  {
+    // Sheets read off the main thread bring their own rubric; swapping it for
+    // the cached one means most students end up sharing a single copy.
+    files.sheet.Intern(&m_rubrics);
+
+    // Most students are graded with the same rubric, so the boxes that are
+    // already there can usually just be ticked differently.
+    bool rebuild = !m_sheet.HasSameStructure(files.sheet);
+
+    m_sheet.Swap(files.sheet);
+    if (rebuild)
+    {
+      m_panel->Reset();
+      m_panel->BuildPanel();
+    }
+    else
+      m_panel->UpdatePanel();
+
+    // A sheet the tests marked still needs saving, even if nothing's changed.
+    m_panel->MarkSaved(files.graded && m_sheet.m_pending.empty());
+    if (!m_sheet.m_pending.empty())
+    {
+      GradingText *tests = new GradingText(m_notebook);
+      tests->SetContent(m_sheet.m_pending.c_str(), m_sheet.m_pending.length());
+      m_notebook->AddPage(tests, "Tests", false);
+    }
+
+    ShowSuggestions(files.suggestions);
+  }
   else
-    LoadScoreSheet(m_templateFilename);
+  {
+    wxMessageBox(("I failed to open a file I was expecting to be able to open. What's the deal with that? (" + files.sheetError.ToString() + ")").c_str(), "Oops.", wxOK, this);
+    m_sheet.Clear();
+    m_panel->Reset();
+    m_panel->MarkSaved();
+  }
 
   if (m_texts.size() == 0)
   {
@@ -680,158 +788,179 @@ void GradingTools::OpenFiles(bool build)
   }
 }
 
-struct sCheckboxIndex {int cat, ded, crt;};
-void GradingTools::ParseScoreSheet(std::string content)
+// Shows the file that was picked in the outline, scrolled to the line.
+void GradingTools::OnOutline(wxCommandEvent &e)
 {
-  std::stringstream sheet(content);
-  std::string line;
-  GradingCategory *cat = NULL;
-  GradingDeduction *ded = NULL;
-
-  std::vector<sCheckboxIndex> onBoxes;
-  sCheckboxIndex cBox = {-1, -1, -1};
+  std::string filename;
+  int line;
+  if (!m_outline->GetPlace(e.GetInt(), &filename, &line))
+    return;
 
-  while (sheet.good())
+  for (size_t page = 0; page < m_notebook->GetPageCount(); page++)
   {
-    getline(sheet, line);
+    GradingText *text = NULL;
+    for (size_t i = 0; i < m_texts.size(); i++)
+    {
+      if (m_notebook->GetPage(page) == m_texts[i] && m_texts[i]->m_filename == filename)
+        text = m_texts[i];
+    }
+    if (text == NULL)
+      continue;
 
-    // Categories and strings force the pending category to resolve
-    if (line[0] == 'C' || line[0] == 'S')
+    m_notebook->SetSelection(page);
+    long position = text->XYToPosition(0, line - 1);
+    if (position >= 0)
     {
-      if (cat != NULL)
-      {
-        if (ded != NULL)
-        {
-          cat->AddDeduction(*ded);
-          delete ded;
-          ded = NULL;
-        }
-        m_categories.push_back(*cat);
-        delete cat;
-        cat = NULL;
-      }
+      text->SetInsertionPoint(position);
+      text->ShowPosition(position);
+    }
+    return;
+  }
+}
 
-      if (line[0] == 'C')
-      {
-        cBox.cat++;
-        cBox.ded = cBox.crt = -1;
+// Adds a student to the back of the compiler's line.
+void GradingTools::Compile(std::string directory)
+{
+  if (m_compiler)
+    m_compiler->Add(directory);
+}
 
-        float value;
-        sscanf(line.c_str(), "CAT [%f]", &value);
-        std::string label(&line[line.find_last_of(']')] + 2);
-        cat = new GradingCategory(value, label, std::vector<GradingDeduction>());
-      }
-      else
-        m_strings.push_back(GradingString((line.length() > 4)?(line.substr(4)):(""), m_categories.size(), this));
-    }
-    // Deduction
-    else if (line[line.find_first_not_of('\t')] == 'D')
-    {
-      cBox.ded++;
-      cBox.crt = -1;
-      if (ded != NULL)
-      {
-        cat->AddDeduction(*ded);
-        delete ded;
-        ded = NULL;
-      }
+// Starts reading a student's directory in the background, ahead of UpdateDirectory.
+void GradingTools::Prefetch(std::string directory)
+{
+  if (m_prefetch)
+    m_prefetch->Request(directory);
+}
 
-      // If this deduction is simple and applied, remember to check its box later
-      if (line[line.find('[') + 1] == 'X')
-      {
-        cBox.crt = 0;
-        onBoxes.push_back(cBox);
-      }
+// Fills in the compiler's page for the current student, or says it's still
+// working on them.
+void GradingTools::ShowCompileResult()
+{
+  if (m_compilerText == NULL)
+    return;
 
-      ded = new GradingDeduction();
-      std::stringstream points(line.substr(line.find_last_of('[') + 1, line.find_last_of(']') - line.find_last_of('[') - 1));
-      std::string item;
-      int index = 1;
-      while (std::getline(points, item, ','))
-      {
-        float value;
-        sscanf(item.c_str(), "%f", &value);
-        ded->SetMapping(index++, value);
-      }
-      std::string label(&line[line.find_last_of(']')] + 2);
-      ded->SetLabel(label);
-    }
-    // Criterion
-    else if (line[line.find_first_not_of('\t')] == 'C')
-    {
-      cBox.crt++;
-      std::string label(&line[line.find_last_of(']')] + 2);
-      ded->AddChoice(label);
+  size_t page = 0;
+  while (page < m_notebook->GetPageCount() && m_notebook->GetPage(page) != m_compilerText)
+    page++;
+  if (page == m_notebook->GetPageCount())
+    return;
 
-      // If this criterion is checked, remember to make it so later
-      if (line[line.find('[') + 1] == 'X')
-        onBoxes.push_back(cBox);
-    }
-    // Notes
-    else if (line[line.find_first_not_of('\t')] == 'N')
-    {
-      std::string notes;
-      while (sheet.good())
-      {
-        getline(sheet, line);
-        notes += line + '\n';
-      }
-      m_panel->SetNotes(notes);
-    }
+  sCompileResult result;
+  std::string title, text;
+  if (!m_compiler->GetResult(m_directory, &result))
+  {
+    title = "Compiling...";
+    text = "Still compiling. This fills in by itself when it's done.";
   }
-  if (cat != NULL)
+  else if (!result.ran)
   {
-    if (ded != NULL)
+    title = "Not compiled";
+    text = result.output;
+  }
+  else if (result.status == 0)
+  {
+    title = "Compiles";
+    text = result.output.empty()?"No complaints.":result.output;
+  }
+  else
+  {
+    title = "Doesn't compile";
+    text = result.output;
+  }
+
+  m_notebook->SetPageText(page, title.c_str());
+  m_compilerText->SetContent(text.c_str(), text.length());
+}
+
+// Rules only ever suggest: the boxes are shaded on the checklist, the lines that
+// set them off are shaded in the files, and a page says why. None of it is
+// saved. Suggestions are numbered by the template's boxes, so they're only
+// shaded on sheets that still have the same ones.
+void GradingTools::ShowSuggestions(const std::vector<sRuleSuggestion> &suggestions)
+{
+  GradingBoxSet suggested;
+  bool matching = (m_template != NULL && m_sheet.GetRubric() != NULL && m_sheet.GetRubric()->HasSameStructure(*m_template));
+  if (matching && suggestions.size() > 0)
+    suggested.Assign(m_template->m_boxCount);
+
+  std::string reasons;
+  std::vector<bool> shown(m_texts.size(), false);
+  for (size_t i = 0; i < suggestions.size(); i++)
+  {
+    const sRuleSuggestion &suggestion = suggestions[i];
+    if (matching)
+      suggested.Set(m_template->m_categories[suggestion.category].m_dedux[suggestion.deduction].m_firstBox + suggestion.box, true);
+    reasons += m_rules[suggestion.rule].label + ": " + suggestion.reason + '\n';
+
+    // Each file is scrolled to its first hit.
+    for (size_t j = 0; j < suggestion.hits.size(); j++)
     {
-      cat->AddDeduction(*ded);
-      delete ded;
-      ded = NULL;
+      for (size_t k = 0; k < m_texts.size(); k++)
+      {
+        if (m_texts[k]->m_filename != suggestion.hits[j].filename)
+          continue;
+
+        m_texts[k]->HighlightLine(suggestion.hits[j].line, !shown[k]);
+        shown[k] = true;
+      }
     }
-    m_categories.push_back(*cat);
-    delete cat;
-    cat = NULL;
   }
 
-  m_maxPoints = 0;
-  for (size_t i = 0; i < m_categories.size() - 1; i++)
-    m_maxPoints += m_categories[i].m_value;
-
-  for (unsigned int i = 0; i < m_categories.size(); i++)
-    m_panel->AddCategory(m_categories[i]);
+  m_panel->SetSuggested(suggested);
 
-  m_totalPoints = m_maxPoints;
-  m_panel->SetPoints(m_maxPoints);
+  if (!reasons.empty())
+  {
+    GradingText *rules = new GradingText(m_notebook);
+    rules->SetContent(reasons.c_str(), reasons.length());
+    m_notebook->AddPage(rules, "Rules", false);
+  }
+}
 
-  for (size_t i = 0; i < onBoxes.size(); i++)
-    SetDeductionBox(onBoxes[i].cat, onBoxes[i].ded, onBoxes[i].crt, true);
-  for (size_t i = 0; i < m_categories.size(); i++)
-    m_categories[i].UpdateTotal(&m_totalPoints);
+void GradingTools::ParseScoreSheet(std::string content)
+{
+  sParseError error;
+  if (!m_sheet.Parse(content, &error))
+    wxMessageBox(("That score sheet doesn't look right (" + error.ToString() + ").").c_str(), "Oops.", wxOK, this);
 
-  m_panel->SetPoints(m_totalPoints);
+  m_sheet.Intern(&m_rubrics);
+  m_panel->BuildPanel();
+  m_panel->MarkSaved();
 }
 
 void GradingTools::SetDeductionBox(int category, int deduction, int box, bool state)
 {
-  m_categories[category].SetDeductionBox(deduction, box, state);
+  m_sheet.SetDeductionBox(category, deduction, box, state);
 }
 
 float GradingTools::GetTotalPoints() const
 {
-  return m_totalPoints;
+  return m_sheet.m_totalPoints;
 }
 
 float GradingTools::GetMaxPoints() const
 {
-  return m_maxPoints;
+  return m_sheet.GetMaxPoints();
+}
+
+bool GradingTools::IsModified()
+{
+  return m_panel->IsModified();
 }
 
-void GradingTools::UpdateDirectory()
+// NULL if the template couldn't be read.
+const GradingRubric *GradingTools::GetTemplate() const
 {
-  m_totalPoints = 0;
+  return m_template;
+}
 
-  m_categories.clear();
-  m_strings.clear();
-  m_panel->Reset();
+const sAssignmentPart &GradingTools::GetAssignmentPart() const
+{
+  return s_assmtParts[m_part];
+}
+
+void GradingTools::UpdateDirectory(std::string directory)
+{
+  m_directory = directory;
 
   OpenFiles(false);
 
@@ -7,97 +7,61 @@
 
 #include <wx/bookctrl.h>
 #include <wx/spinctrl.h>
+#include <wx/vlbox.h>
 #include <wx/richtext/richtextctrl.h>
 
-// Strings are simply put into the output grade file literally, with a few
-// bells and whistles for formatting.
-//   %t - Replaced with the student's total earned points.
-//   %m - Replaced with the assignment's maximum point value.
-
-class GradingTools;
-
-class GradingString
+#include "GradingCompile.h"
+#include "GradingCore.h"
+#include "GradingPrefetch.h"
+#include "GradingWriter.h"
+
+// Sent up to the frame whenever the current student goes from saved to modified
+// or back. The event's int is 1 if there's something unsaved.
+BEGIN_DECLARE_EVENT_TYPES()
+  DECLARE_EVENT_TYPE(wxEVT_GRADING_MODIFIED, -1)
+END_DECLARE_EVENT_TYPES()
+
+// The checklist shows every deduction and criterion on a sheet as one long list
+// of rows, drawn by hand. Only the rows that are on screen ever get drawn, so a
+// rubric with thousands of boxes is no slower to show than one with ten. Each
+// row just remembers which box it is, so a click goes straight to the sheet.
+// Toggling a box sends a wxEVT_COMMAND_CHECKLISTBOX_TOGGLED with the row as
+// its int. Boxes the template's rules suggest are shaded, checked or not.
+
+class GradingChecklist: public wxVListBox
 {
-  public:
-  GradingString();
-  GradingString(std::string text, int precedes, GradingTools *owner);
-  GradingString(const GradingString &s);
-
-  GradingString &operator=(const GradingString &s);
-
-  std::string m_text;
-
-  // The 'precedes' value indicates which category (by index) this
-  // string should immediately precede in the output. If two strings
-  // have the same value, they are written in the order they were
-  // read from the template.
-  int m_precedes;
+  DECLARE_CLASS(GradingChecklist)
 
-  GradingTools *m_owner;
-
-  std::string Print() const;
-  std::string ToString() const;
-};
-
-// Deductions are the components of the grade that subtract points. Each one
-// has a condition and a point value; the understanding is that when the condition
-// is met, the (usually negative) point value is added to the student's score.
-
-class GradingDeduction
-{
-  public:
-  GradingDeduction();
-  GradingDeduction(std::string label);
-  GradingDeduction(const GradingDeduction &d);
-
-  GradingDeduction &operator=(const GradingDeduction &d);
-
-  std::string m_label;
-  float m_recorded;   // This deduction's current value in the total score sum.
-
-  std::vector<wxCheckBox *> m_checkboxes;
-  std::vector<std::string> m_choices; // For umbrella deductions.
-  std::vector<float> m_mapping;       // The mapping from number of flaws to points taken off.
-
-  void SetLabel(std::string label);
-  void SetCheckbox(int index, bool state);
-  void SetMapping(int index, float value);
-  float GetValue() const;
-  float GetMaxValue() const;
+  protected:
+  enum {
+    ROW_CATEGORY,
+    ROW_DEDUCTION,  // Heading for a deduction with criteria under it.
+    ROW_BOX
+  };
 
-  void UpdateTotal(float *total);
-  void AddChoice(std::string label);
-  std::string Print() const;
-  void Reset();
+  struct sRow {int type, cat, ded, box;};
 
-  wxSizer *BuildPanel(wxWindow *parent, int *currentID);
+  GradingSheet *m_sheet;
+  std::vector<sRow> m_rows;
+  GradingBoxSet m_suggested;  // Empty if nothing's suggested.
+  wxFont m_boldFont;
 
-  std::string ToString() const;
-};
+  void OnDrawItem(wxDC &dc, const wxRect &rect, size_t n) const;
+  wxCoord OnMeasureItem(size_t n) const;
 
-// Categories are the level up from deductions. They have a description and total
-// point value, and house any number of deductions that are relevant. These would
-// usually be problems in an assignment, or pieces of particularly large problems.
+  void Toggle(size_t n);
+  void OnLeftDown(wxMouseEvent &e);
+  void OnKeyDown(wxKeyEvent &e);
 
-class GradingCategory
-{
   public:
-  GradingCategory();
-  GradingCategory(float value, std::string label, std::vector<GradingDeduction> dedux);
-  GradingCategory(const GradingCategory &c);
-
-  GradingCategory &operator=(const GradingCategory &c);
+  GradingChecklist(wxWindow *parent, wxWindowID id, GradingSheet *sheet);
+  ~GradingChecklist();
 
-  std::vector<GradingDeduction> m_dedux;
-  std::string m_label;
-  float m_value;
+  void Build();
+  void Clear();
+  void SetSuggested(const GradingBoxSet &suggested);
 
-  void UpdateTotal(float *total);
-  void AddDeduction(GradingDeduction d);
-  void SetDeductionBox(int deduction, int box, bool state);
-  void Reset();
-
-  std::string ToString() const;
+  DECLARE_EVENT_TABLE()
 };
 
 class GradingPanel: public wxScrolledWindow
@@ -106,29 +70,41 @@ class GradingPanel: public wxScrolledWindow
 
   protected:
   enum {
-    ID_DEDUCTION = 6300,
+    ID_CHECKLIST = 6300,
     ID_NOTE = 6400
   };
 
   wxStaticText *m_pointsText;
   wxRichTextCtrl *m_notesText;
 
-  float *m_total;
-  std::vector<GradingDeduction *> m_deduxMapping;
-  wxSizer *m_deduxBox;
-  int m_currentID;
+  GradingSheet *m_sheet;
+  GradingChecklist *m_checklist;
+
+  // What the student looked like when they were loaded or last saved.
+  GradingBoxSet m_savedApplied;
+  std::string m_savedNotes;
+  bool m_saved;     // False if they've never been saved at all.
+  bool m_modified;  // As of the last time the frame was told.
+  bool m_settingNotes;  // While SetNotes is filling in the notes box.
 
   void OnDeduction(wxCommandEvent &e);
+  void OnNotes(wxCommandEvent &e);
+  void CheckModified();
 
   public:
-  GradingPanel(wxWindow *parent, float *total);
+  GradingPanel(wxWindow *parent, GradingSheet *sheet);
   ~GradingPanel();
 
-  void AddCategory(GradingCategory &cat);
+  void BuildPanel();
+  void UpdatePanel();
   void SetPoints(float points);
   std::string GetNotes();
   void SetNotes(std::string notes);
 
+  void MarkSaved(bool saved = true);
+  bool IsModified();
+  void SetSuggested(const GradingBoxSet &suggested);
+
   void Reset();
 
   friend class GradingTools;
@@ -145,9 +121,13 @@ class GradingText: public wxRichTextCtrl
 
   public:
   GradingText(std::string filename, wxWindow *parent);
+  GradingText(const sStudentFile &file, wxWindow *parent);
+  GradingText(wxWindow *parent);
   ~GradingText();
 
   void Load(std::string filename);
+  void SetContent(const char *data, size_t length);
+  void HighlightLine(int line, bool show = false);
   void Save();
 
   friend class GradingTools;
@@ -155,34 +135,60 @@ class GradingText: public wxRichTextCtrl
   DECLARE_EVENT_TABLE()
 };
 
+// Lists the classes and methods in a student's Java files, beside the files
+// themselves, so they can be jumped to. Every row remembers where it points.
+class GradingOutlineList: public wxListBox
+{
+  DECLARE_CLASS(GradingOutlineList)
+
+  protected:
+  std::vector<std::string> m_filenames;  // One for each row.
+  std::vector<int> m_lines;
+
+  public:
+  GradingOutlineList(wxWindow *parent, wxWindowID id);
+  ~GradingOutlineList();
+
+  bool SetOutlines(const sStudentFiles &files);
+  bool GetPlace(int row, std::string *filename, int *line) const;
+};
+
 class GradingTools: public wxPanel
 {
   DECLARE_CLASS(GradingTools)
 
   protected:
+  enum
+  {
+    ID_OUTLINE = 6500
+  };
+
   GradingPanel *m_panel;
   std::vector<GradingText *> m_texts;
   wxNotebook *m_notebook;
+  GradingOutlineList *m_outline;
+  GradingPrefetch *m_prefetch;
+  GradingWriter *m_writer;
+  GradingManifest *m_manifest;  // The roster's; NULL to always list directories.
+  GradingCompiler *m_compiler;  // NULL if the part isn't compiled.
+  GradingText *m_compilerText;  // The compiler's page, if it's showing.
+  std::string m_directory;
   std::string m_filename;
   std::string m_templateFilename;
   int m_part;
 
-  float m_totalPoints;
-  float m_maxPoints;
-
-  std::vector<GradingString> m_strings;
-  std::vector<GradingCategory> m_categories;
+  GradingRubricCache m_rubrics;
+  const GradingRubric *m_template;
+  GradingSheet m_sheet;
+  std::vector<sRule> m_rules;
+  GradingRuleMatcher *m_matcher;  // For students read on this thread; NULL without rules.
+  GradingOutlineCache m_outlines;  // Shared with the prefetcher.
 
-  struct sAssignmentPart
-  {
-    std::string name;
-    std::string submissionFilter;
-    std::string gradeFileFilter;
-  };
   static std::vector<sAssignmentPart> s_assmtParts;
 
   public:
-  GradingTools(int part, wxWindow *parent, std::string templateFilename);
+  GradingTools(int part, wxWindow *parent, std::string templateFilename, std::string directory,
+    GradingManifest *manifest = NULL);
   ~GradingTools();
 
   static std::vector<wxString> GetAssignmentParts();
@@ -192,14 +198,28 @@ class GradingTools: public wxPanel
   void SaveScoreFile();
 
   void OpenFiles(bool build);
-  void BuildCategories(std::string content);
+  void ShowFiles(sStudentFiles &files);
+  void Prefetch(std::string directory);
+  void Compile(std::string directory);
   void ParseScoreSheet(std::string content);
 
   void SetDeductionBox(int category, int deduction, int box, bool state);
   float GetTotalPoints() const;
   float GetMaxPoints() const;
+  bool IsModified();
+
+  const GradingRubric *GetTemplate() const;
+  const sAssignmentPart &GetAssignmentPart() const;
 
-  void UpdateDirectory();
+  void UpdateDirectory(std::string directory);
+
+  protected:
+  void QueueWrite(std::string filename, std::string content);
+  void ShowCompileResult();
+  void ShowSuggestions(const std::vector<sRuleSuggestion> &suggestions);
+  void OnWriteFailed(wxCommandEvent &e);
+  void OnCompiled(wxCommandEvent &e);
+  void OnOutline(wxCommandEvent &e);
 
   DECLARE_EVENT_TABLE()
 };
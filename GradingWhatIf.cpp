@@ -0,0 +1,346 @@
+#include "GradingWhatIf.h"
+
+#include <wx/filefn.h>
+#include <wx/stopwatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+//-----GradingHistogram-----
+
+IMPLEMENT_CLASS(GradingHistogram, wxPanel)
+
+BEGIN_EVENT_TABLE(GradingHistogram, wxPanel)
+  EVT_PAINT(GradingHistogram::OnPaint)
+END_EVENT_TABLE()
+
+GradingHistogram::GradingHistogram(wxWindow *parent):
+  wxPanel(parent, wxID_ANY, wxDefaultPosition, wxSize(300, 150), wxSUNKEN_BORDER)
+{
+  m_bins.assign(BINS, 0);
+}
+
+void GradingHistogram::SetBins(const std::vector<int> &bins)
+{
+  m_bins = bins;
+  Refresh();
+}
+
+void GradingHistogram::OnPaint(wxPaintEvent &e)
+{
+  wxPaintDC dc(this);
+  wxSize size = GetClientSize();
+
+  int most = 1;
+  for (size_t i = 0; i < m_bins.size(); i++)
+    most = std::max(most, m_bins[i]);
+
+  int width = size.x / BINS;
+  int labelHeight = GetCharHeight() + 2;
+  int barSpace = size.y - labelHeight - 2;
+
+  dc.SetPen(*wxBLACK_PEN);
+  dc.SetBrush(wxBrush(wxSystemSettings::GetColour(wxSYS_COLOUR_HIGHLIGHT)));
+
+  for (int i = 0; i < BINS; i++)
+  {
+    int height = barSpace * m_bins[i] / most;
+    if (height > 0)
+      dc.DrawRectangle(i * width + 1, size.y - labelHeight - height, width - 2, height);
+
+    dc.DrawText(wxString::Format("%d", i * (100 / BINS)), i * width + 2, size.y - labelHeight + 1);
+  }
+}
+
+//-----GradingWhatIf-----
+
+IMPLEMENT_CLASS(GradingWhatIf, wxDialog)
+
+BEGIN_EVENT_TABLE(GradingWhatIf, wxDialog)
+  EVT_LISTBOX(ID_ITEMS, GradingWhatIf::OnSelect)
+  EVT_TEXT(ID_VALUE, GradingWhatIf::OnValue)
+  EVT_BUTTON(ID_RESET, GradingWhatIf::OnReset)
+END_EVENT_TABLE()
+
+GradingWhatIf::GradingWhatIf(wxWindow *parent, const GradingRubric *tmpl, GradingRoster &roster, const sAssignmentPart &part):
+  wxDialog(parent, wxID_ANY, "What if...", wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER),
+  m_template(tmpl)
+{
+  m_skipped = 0;
+  m_unconfirmed = 0;
+  m_matrix.SetRubric(tmpl);
+
+  const std::vector<GradingCategory> &categories = tmpl->m_categories;
+  for (int i = 0; i < (int)categories.size(); i++)
+  {
+    sItem category = {i, -1};
+    m_items.push_back(category);
+    m_values.push_back(categories[i].m_value);
+
+    for (int j = 0; j < (int)categories[i].m_dedux.size(); j++)
+    {
+      sItem deduction = {i, j};
+      m_items.push_back(deduction);
+      m_mappings.push_back(categories[i].m_dedux[j].m_mapping);
+    }
+  }
+
+  wxBoxSizer *topSizer = new wxBoxSizer(wxVERTICAL);
+  wxBoxSizer *columns = new wxBoxSizer(wxHORIZONTAL);
+  topSizer->Add(columns, 1, wxGROW | wxALL, 4);
+
+  // The template's values
+  wxStaticBoxSizer *sizer = new wxStaticBoxSizer(wxVERTICAL, this, "Template");
+  m_itemList = new wxListBox(this, ID_ITEMS, wxDefaultPosition, wxSize(350, 350));
+  for (size_t i = 0; i < m_items.size(); i++)
+    m_itemList->Append(GetItemText(i).c_str());
+  sizer->Add(m_itemList, 1, wxGROW | wxALL, 2);
+
+  sizer->Add(new wxStaticText(this, wxID_ANY, "Points for the category, or for 1, 2, 3... boxes in the deduction:"), 0, wxALL, 2);
+  m_valueText = new wxTextCtrl(this, ID_VALUE);
+  sizer->Add(m_valueText, 0, wxGROW | wxALL, 2);
+  sizer->Add(new wxButton(this, ID_RESET, "Put everything back"), 0, wxALL, 2);
+  columns->Add(sizer, 1, wxGROW | wxALL, 2);
+
+  // What they'd do to the roster
+  sizer = new wxStaticBoxSizer(wxVERTICAL, this, "Roster");
+  m_statsText = new wxStaticText(this, wxID_ANY, "");
+  sizer->Add(m_statsText, 0, wxGROW | wxALL, 2);
+  m_histogram = new GradingHistogram(this);
+  sizer->Add(m_histogram, 0, wxGROW | wxALL, 2);
+  sizer->Add(new wxStaticText(this, wxID_ANY, "Letter grades that would change:"), 0, wxALL, 2);
+  m_changeList = new wxListBox(this, wxID_ANY, wxDefaultPosition, wxSize(300, 150));
+  sizer->Add(m_changeList, 1, wxGROW | wxALL, 2);
+  columns->Add(sizer, 1, wxGROW | wxALL, 2);
+
+  topSizer->Add(CreateButtonSizer(wxOK), 0, wxALIGN_RIGHT | wxALL, 6);
+
+  SetSizer(topSizer);
+  topSizer->SetSizeHints(this);
+
+  LoadRoster(roster, part);
+
+  m_matrix.Score();
+  for (size_t i = 0; i < m_students.size(); i++)
+    m_basePercents.push_back(GetPercent(i));
+
+  Recompute();
+}
+
+GradingWhatIf::~GradingWhatIf()
+{
+}
+
+// Reads every student's score sheet into the matrix. This is the slow part, so
+// it only happens once.
+void GradingWhatIf::LoadRoster(GradingRoster &roster, const sAssignmentPart &part)
+{
+  wxBusyCursor busy;
+
+  for (size_t i = 0; i < roster.GetCount(); i++)
+  {
+    std::string dirname = roster.GetStudentPath(i);
+
+    sPartFiles files;
+    if (!roster.GetManifest()->GetPartFiles(dirname, part, &files) || files.gradeFilename.empty())
+      continue;
+
+    // Students nobody has graded yet don't count.
+    std::string scoreFilename = GradingSheet::ScoreFilename(dirname + '/' + files.gradeFilename);
+    if (!wxFileExists(scoreFilename))
+      continue;
+
+    // Neither do ones only the tests have marked, until somebody saves them.
+    GradingSheet sheet;
+    bool loaded = sheet.Load(scoreFilename);
+    if (loaded && !sheet.m_pending.empty())
+    {
+      m_unconfirmed++;
+      continue;
+    }
+
+    if (!loaded || !m_matrix.AddStudent(sheet))
+    {
+      m_skipped++;
+      continue;
+    }
+
+    m_students.push_back(roster.GetStudent(i));
+  }
+}
+
+std::string GradingWhatIf::GetItemText(size_t item) const
+{
+  const GradingCategory &cat = m_template->m_categories[m_items[item].category];
+
+  if (m_items[item].deduction < 0)
+    return "CAT [" + GetValueText(item) + "] " + cat.m_label;
+
+  return "      DED [" + GetValueText(item) + "] " + cat.m_dedux[m_items[item].deduction].m_label;
+}
+
+std::string GradingWhatIf::GetValueText(size_t item) const
+{
+  if (m_items[item].deduction < 0)
+    return formatFloat(m_values[m_items[item].category]);
+
+  const std::vector<float> &mapping = m_mappings[m_matrix.GetDeduction(m_items[item].category, m_items[item].deduction)];
+  std::string text;
+  for (size_t i = 0; i < mapping.size(); i++)
+    text += (i > 0?", ":"") + formatFloat(mapping[i]);
+
+  return text;
+}
+
+float GradingWhatIf::GetPercent(size_t student) const
+{
+  float max = m_matrix.GetMaxPoints();
+  return (max > 0.0f)?m_matrix.GetTotal(student) / max * 100.0f:0.0f;
+}
+
+// The usual scale, by percentage of the maximum.
+const char *GradingWhatIf::GetLetter(float percent)
+{
+  static const struct {float min; const char *letter;} scale[] = {
+    {93.0f, "A"}, {90.0f, "A-"},
+    {87.0f, "B+"}, {83.0f, "B"}, {80.0f, "B-"},
+    {77.0f, "C+"}, {73.0f, "C"}, {70.0f, "C-"},
+    {60.0f, "D"}
+  };
+
+  for (size_t i = 0; i < sizeof(scale) / sizeof(scale[0]); i++)
+    if (percent >= scale[i].min)
+      return scale[i].letter;
+
+  return "F";
+}
+
+// Rescores the whole roster with the values as they are now. This runs on
+// every keystroke, so it sticks to the matrix and doesn't touch the sheets.
+void GradingWhatIf::Recompute()
+{
+  wxStopWatch watch;
+  m_matrix.Score();
+
+  size_t count = m_students.size();
+  std::vector<float> totals(count);
+  std::vector<int> bins(GradingHistogram::BINS, 0);
+  wxArrayString changes;
+  double sum = 0.0;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    totals[i] = m_matrix.GetTotal(i);
+    sum += totals[i];
+
+    float percent = GetPercent(i);
+    int bin = (int)(percent / (100 / GradingHistogram::BINS));
+    bins[std::max(0, std::min(bin, GradingHistogram::BINS - 1))]++;
+
+    const char *before = GetLetter(m_basePercents[i]), *after = GetLetter(percent);
+    if (strcmp(before, after) != 0)
+      changes.Add((m_students[i] + ": " + before + " (" + formatFloat(m_basePercents[i]) + "%) to " +
+        after + " (" + formatFloat(percent) + "%)").c_str());
+  }
+
+  // The median is found without sorting everything.
+  float median = 0.0f;
+  if (count > 0)
+  {
+    std::nth_element(totals.begin(), totals.begin() + count / 2, totals.end());
+    median = totals[count / 2];
+    if (count % 2 == 0)
+      median = (median + *std::max_element(totals.begin(), totals.begin() + count / 2)) / 2.0f;
+  }
+
+  std::string max = formatFloat(m_matrix.GetMaxPoints());
+  std::string stats = "Mean: " + formatFloat(count > 0?sum / count:0.0f) + " / " + max +
+    "\nMedian: " + formatFloat(median) + " / " + max + "\n";
+  stats += wxString::Format("%u students, rescored in %ld ms", (unsigned int)count, watch.Time()).c_str();
+  if (m_skipped > 0)
+    stats += wxString::Format("\n(%u graded with a different template are left out)", (unsigned int)m_skipped).c_str();
+  if (m_unconfirmed > 0)
+    stats += wxString::Format("\n(%u marked by the tests but not saved yet are left out)", (unsigned int)m_unconfirmed).c_str();
+
+  m_statsText->SetLabel(stats.c_str());
+  m_histogram->SetBins(bins);
+  m_changeList->Set(changes);
+}
+
+void GradingWhatIf::OnSelect(wxCommandEvent &e)
+{
+  int selection = m_itemList->GetSelection();
+  if (selection != wxNOT_FOUND)
+    m_valueText->ChangeValue(GetValueText(selection).c_str());
+}
+
+// Half-typed values are just ignored until they make sense.
+void GradingWhatIf::OnValue(wxCommandEvent &e)
+{
+  int selection = m_itemList->GetSelection();
+  if (selection == wxNOT_FOUND)
+    return;
+
+  std::string text = m_valueText->GetValue().c_str();
+  std::vector<float> values;
+  const char *pos = text.c_str();
+  while (true)
+  {
+    while (*pos == ' ' || *pos == ',' || *pos == '\t')
+      pos++;
+    if (*pos == '\0')
+      break;
+
+    char *end;
+    float value = (float)strtod(pos, &end);
+    if (end == pos)
+      return;
+
+    values.push_back(value);
+    pos = end;
+  }
+
+  const sItem &item = m_items[selection];
+  if (item.deduction < 0)
+  {
+    if (values.size() != 1)
+      return;
+
+    m_values[item.category] = values[0];
+    m_matrix.SetCategoryValue(item.category, values[0]);
+  }
+  else
+  {
+    size_t deduction = m_matrix.GetDeduction(item.category, item.deduction);
+    if (values.size() == 0 || !m_matrix.SetMapping(deduction, values))
+      return;
+
+    m_mappings[deduction] = values;
+  }
+
+  m_itemList->SetString(selection, GetItemText(selection).c_str());
+  Recompute();
+}
+
+void GradingWhatIf::OnReset(wxCommandEvent &e)
+{
+  const std::vector<GradingCategory> &categories = m_template->m_categories;
+  for (size_t i = 0; i < categories.size(); i++)
+  {
+    m_values[i] = categories[i].m_value;
+    m_matrix.SetCategoryValue(i, m_values[i]);
+
+    for (size_t j = 0; j < categories[i].m_dedux.size(); j++)
+    {
+      size_t deduction = m_matrix.GetDeduction(i, j);
+      m_mappings[deduction] = categories[i].m_dedux[j].m_mapping;
+      m_matrix.SetMapping(deduction, m_mappings[deduction]);
+    }
+  }
+
+  for (size_t i = 0; i < m_items.size(); i++)
+    m_itemList->SetString(i, GetItemText(i).c_str());
+
+  OnSelect(e);
+  Recompute();
+}
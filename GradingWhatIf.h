@@ -0,0 +1,92 @@
+#ifndef GRADINGWHATIF_H
+#define GRADINGWHATIF_H
+
+#include <wx/wx.h>
+#include <string>
+#include <vector>
+
+#include "GradingCore.h"
+#include "GradingRoster.h"
+#include "GradingScores.h"
+
+// Draws how many students landed in each tenth of the maximum score.
+
+class GradingHistogram: public wxPanel
+{
+  DECLARE_CLASS(GradingHistogram)
+
+  protected:
+  std::vector<int> m_bins;
+
+  void OnPaint(wxPaintEvent &e);
+
+  public:
+  enum { BINS = 10 };
+
+  GradingHistogram(wxWindow *parent);
+
+  void SetBins(const std::vector<int> &bins);
+
+  DECLARE_EVENT_TABLE()
+};
+
+// The what-if dialog tries out different point values for the template on
+// everyone who's been graded so far. Every score sheet under the roster is read
+// once when it opens, into a score matrix, and every change to a value
+// rescores the whole roster from that. It shows the mean and median, a
+// histogram, and whoever would get a different letter grade than they do with
+// the template as it is. Nothing is ever written; students graded with a
+// template with different boxes than this one are left out, and so are ones
+// the tests marked that nobody's confirmed yet.
+
+class GradingWhatIf: public wxDialog
+{
+  DECLARE_CLASS(GradingWhatIf)
+
+  protected:
+  enum {
+    ID_ITEMS = 6600,
+    ID_VALUE,
+    ID_RESET
+  };
+
+  // A category if deduction is -1, otherwise one of its deductions.
+  struct sItem {int category, deduction;};
+
+  const GradingRubric *m_template;
+  GradingScoreMatrix m_matrix;
+  std::vector<std::string> m_students;
+  std::vector<float> m_basePercents;  // With the template's own values.
+  size_t m_skipped;
+  size_t m_unconfirmed;  // Sheets only the tests have marked.
+
+  std::vector<sItem> m_items;
+  std::vector<float> m_values;
+  std::vector<std::vector<float> > m_mappings;
+
+  wxListBox *m_itemList;
+  wxTextCtrl *m_valueText;
+  wxStaticText *m_statsText;
+  GradingHistogram *m_histogram;
+  wxListBox *m_changeList;
+
+  void LoadRoster(GradingRoster &roster, const sAssignmentPart &part);
+  std::string GetItemText(size_t item) const;
+  std::string GetValueText(size_t item) const;
+  float GetPercent(size_t student) const;
+  void Recompute();
+
+  void OnSelect(wxCommandEvent &e);
+  void OnValue(wxCommandEvent &e);
+  void OnReset(wxCommandEvent &e);
+
+  public:
+  GradingWhatIf(wxWindow *parent, const GradingRubric *tmpl, GradingRoster &roster, const sAssignmentPart &part);
+  ~GradingWhatIf();
+
+  static const char *GetLetter(float percent);
+
+  DECLARE_EVENT_TABLE()
+};
+
+#endif
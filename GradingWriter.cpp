@@ -0,0 +1,110 @@
+#include "GradingWriter.h"
+#include "GradingCore.h"
+
+DEFINE_EVENT_TYPE(wxEVT_GRADING_WRITE_FAILED)
+
+//-----GradingWriter-----
+
+GradingWriter::GradingWriter(wxEvtHandler *handler):
+  wxThread(wxTHREAD_JOINABLE),
+  m_handler(handler),
+  m_condition(m_mutex)
+{
+  m_stop = false;
+}
+
+GradingWriter::~GradingWriter()
+{
+}
+
+// Queues a file to be written. The directory is the student's, so WaitFor knows
+// which writes matter to whoever's about to read it.
+void GradingWriter::Write(std::string directory, std::string filename, std::string content)
+{
+  wxMutexLocker lock(m_mutex);
+
+  for (size_t i = 0; i < m_queue.size(); i++)
+  {
+    if (m_queue[i].filename == filename)
+    {
+      m_queue[i].content.swap(content);
+      return;
+    }
+  }
+
+  sWriteJob job;
+  job.directory = directory;
+  job.filename = filename;
+  job.content.swap(content);
+  m_queue.push_back(job);
+  m_condition.Broadcast();
+}
+
+// Blocks until nothing for the given directory is waiting to be written, so it
+// can be read back without getting the files from before the last save.
+void GradingWriter::WaitFor(std::string directory)
+{
+  wxMutexLocker lock(m_mutex);
+
+  while (IsPending(directory))
+    m_condition.Wait();
+}
+
+void GradingWriter::Stop()
+{
+  wxMutexLocker lock(m_mutex);
+
+  m_stop = true;
+  m_condition.Broadcast();
+}
+
+bool GradingWriter::IsPending(const std::string &directory) const
+{
+  if (m_working == directory)
+    return true;
+
+  for (size_t i = 0; i < m_queue.size(); i++)
+    if (m_queue[i].directory == directory)
+      return true;
+
+  return false;
+}
+
+wxThread::ExitCode GradingWriter::Entry()
+{
+  wxMutexLocker lock(m_mutex);
+
+  while (!m_stop || !m_queue.empty())
+  {
+    if (m_queue.empty())
+    {
+      m_condition.Wait();
+      continue;
+    }
+
+    sWriteJob job;
+    job.directory.swap(m_queue.front().directory);
+    job.filename.swap(m_queue.front().filename);
+    job.content.swap(m_queue.front().content);
+    m_queue.pop_front();
+    m_working = job.directory;
+
+    m_mutex.Unlock();
+    bool ok = WriteFileAtomically(job.filename, job.content);
+    m_mutex.Lock();
+
+    m_working.clear();
+    m_condition.Broadcast();
+
+    if (!ok)
+    {
+      // The string is copied into the event rather than shared with this
+      // thread's copy.
+      wxCommandEvent e(wxEVT_GRADING_WRITE_FAILED);
+      e.SetString(job.filename.c_str());
+      wxPostEvent(m_handler, e);
+    }
+  }
+
+  return 0;
+}
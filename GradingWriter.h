@@ -0,0 +1,52 @@
+#ifndef GRADINGWRITER_H
+#define GRADINGWRITER_H
+
+#include <wx/event.h>
+#include <wx/thread.h>
+#include <string>
+#include <deque>
+
+// Sent to the writer's handler when a file couldn't be saved. The event's
+// string says which one.
+BEGIN_DECLARE_EVENT_TYPES()
+  DECLARE_EVENT_TYPE(wxEVT_GRADING_WRITE_FAILED, -1)
+END_DECLARE_EVENT_TYPES()
+
+// The writer saves grade files and score sheets on a background thread, so
+// moving on to the next student doesn't have to wait on the file server. Every
+// file is written with WriteFileAtomically. If a file is saved again before the
+// last save of it was written, only the newest content gets written. Anything
+// still queued when the writer is stopped is written before it exits.
+
+class GradingWriter: public wxThread
+{
+  public:
+  GradingWriter(wxEvtHandler *handler);
+  ~GradingWriter();
+
+  void Write(std::string directory, std::string filename, std::string content);
+  void WaitFor(std::string directory);
+  void Stop();
+
+  protected:
+  struct sWriteJob
+  {
+    std::string directory;
+    std::string filename;
+    std::string content;
+  };
+
+  wxEvtHandler *m_handler;
+
+  wxMutex m_mutex;
+  wxCondition m_condition;
+  std::deque<sWriteJob> m_queue;
+  std::string m_working;  // Directory of the file being written right now.
+  bool m_stop;
+
+  bool IsPending(const std::string &directory) const;
+
+  ExitCode Entry();
+};
+
+#endif